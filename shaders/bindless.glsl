@@ -0,0 +1,13 @@
+// Global bindless table, set 0 for every pipeline (see BindlessTable in bindless.h)
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+layout(rgba16f, set = 0, binding = 1) uniform image2D storageImages[];
+
+// same binding seen as single channel float images, for the depth pyramid
+layout(r32f, set = 0, binding = 1) uniform image2D depthPyramidImages[];
+
+layout(std430, set = 0, binding = 2) buffer StorageBuffers {
+	uint data[];
+} storageBuffers[];
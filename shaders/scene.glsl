@@ -0,0 +1,13 @@
+// Per-frame camera and lighting, matches GPUSceneData
+#extension GL_EXT_buffer_reference : require
+
+layout(buffer_reference, std430) readonly buffer SceneData{
+	mat4 view;
+	mat4 proj;
+	mat4 viewProj;
+	mat4 prevViewProj;	//what the depth pyramid was rendered with
+	vec4 cameraPosition;
+	vec4 ambientColor;
+	vec4 sunDirection;	//w is intensity
+	vec4 sunColor;
+};
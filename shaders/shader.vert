@@ -1,34 +1,45 @@
 #version 450
 #extension GL_EXT_buffer_reference : require
 
+#include "scene.glsl"
+#include "vertex.glsl"
+
 layout (location = 0) out vec3 outColor;
 layout (location = 1) out vec2 outUV;
 
-struct Vertex {
-	vec3 position;
-	float uvX;
-	vec3 normal;
-	float uvY;
-	vec4 color;
+//matches GPUObjectData
+struct ObjectData {
+	mat4 worldMatrix;
+	vec4 boundingSphere;
+	vec4 vertexQuantization;
+	VertexBuffer vertexBuffer;
+	uint batchIndex;
+	uint batchFirstCommand;
 };
 
-layout(buffer_reference, std430) readonly buffer VertexBuffer{
-	Vertex vertices[];
+layout(buffer_reference, std430) readonly buffer ObjectBuffer{
+	ObjectData objects[];
 };
 
 layout(push_constant) uniform constants{
-	mat4 renderMatrix;
-	VertexBuffer vertexBuffer;
+	SceneData sceneData;
+	ObjectBuffer objectBuffer;
 } PushConstants;
 
 
 void main() 
 {
-	//const array of positions for the triangle
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	//firstInstance of the indirect command is the object index
+	ObjectData object = PushConstants.objectBuffer.objects[gl_InstanceIndex];
+	Vertex v = decodeVertex(object.vertexBuffer.vertices[gl_VertexIndex], object.vertexQuantization);
 
 	//output the position of each vertex
-	gl_Position = PushConstants.renderMatrix * vec4(v.position, 1.0f);
-	outColor = v.color.xyz;
-	outUV = vec2(v.uvX, v.uvY);
+	SceneData scene = PushConstants.sceneData;
+	gl_Position = scene.viewProj * object.worldMatrix * vec4(v.position, 1.0f);
+
+	//sun and ambient per vertex
+	vec3 normal = normalize(mat3(object.worldMatrix) * v.normal);
+	float sun = max(dot(normal, -scene.sunDirection.xyz), 0.0f) * scene.sunDirection.w;
+	outColor = v.color.xyz * (scene.ambientColor.xyz + scene.sunColor.xyz * sun);
+	outUV = v.uv;
 }
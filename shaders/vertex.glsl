@@ -0,0 +1,70 @@
+//vertex buffer layout, matches GPUVertex and VERTEX_FORMAT in vertexformat.h
+//the build passes -DVERTEX_FORMAT to glslc with the same value it gives the engine
+#define VERTEX_FORMAT_FLOAT 0
+#define VERTEX_FORMAT_HALF 1
+#define VERTEX_FORMAT_SNORM16 2
+
+#ifndef VERTEX_FORMAT
+#define VERTEX_FORMAT VERTEX_FORMAT_FLOAT
+#endif
+
+//decoded vertex
+struct Vertex {
+	vec3 position;
+	vec3 normal;
+	vec2 uv;
+	vec4 color;
+};
+
+#if VERTEX_FORMAT == VERTEX_FORMAT_FLOAT
+struct PackedVertex {
+	vec3 position;
+	float uvX;
+	vec3 normal;
+	float uvY;
+	vec4 color;
+};
+#else
+struct PackedVertex {
+	uint positionXY;
+	uint positionZ;
+	uint normal;
+	uint uv;
+	uint color;
+};
+#endif
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer{
+	PackedVertex vertices[];
+};
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+//quantization is xyz offset and w scale of SNORM16 positions, see VertexFormat::quantization
+Vertex decodeVertex(PackedVertex p, vec4 quantization)
+{
+	Vertex v;
+#if VERTEX_FORMAT == VERTEX_FORMAT_FLOAT
+	v.position = p.position;
+	v.normal = p.normal;
+	v.uv = vec2(p.uvX, p.uvY);
+	v.color = p.color;
+#else
+#if VERTEX_FORMAT == VERTEX_FORMAT_HALF
+	v.position = vec3(unpackHalf2x16(p.positionXY), unpackHalf2x16(p.positionZ).x);
+#else
+	v.position = quantization.xyz + vec3(unpackSnorm2x16(p.positionXY), unpackSnorm2x16(p.positionZ).x) * quantization.w;
+#endif
+	v.normal = octahedralDecode(unpackSnorm2x16(p.normal));
+	v.uv = unpackHalf2x16(p.uv);
+	v.color = unpackUnorm4x8(p.color);
+#endif
+	return v;
+}
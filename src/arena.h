@@ -0,0 +1,134 @@
+#pragma once
+
+#include "utils.h"
+
+#include <memory>
+#include <cstddef>
+
+// Bump allocator for data that only lives until a frame's fence signals. Nothing is freed on its own, reset() drops
+// everything at once. Blocks are kept across resets, and a frame that needed more than one block gets a single block
+// big enough for all of it on the next reset, so the arena settles after a few frames and stops touching the heap.
+class LinearArena {
+public:
+    explicit LinearArena(size_t blockSize = FRAME_ARENA_SIZE): blockSize(blockSize) {}
+
+    LinearArena(const LinearArena&) = delete;
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)){
+        if(blocks.empty()){
+            addBlock(std::max(blockSize, size + alignment));
+        }
+
+        std::byte* start = tryAllocate(size, alignment);
+        while(start == nullptr){
+            current++;
+            offset = 0;
+            if(current == blocks.size()){
+                addBlock(std::max(blocks.back().size * 2, size + alignment));
+            }
+            start = tryAllocate(size, alignment);
+        }
+
+        usedBytes += size;
+        return start;
+    }
+
+    template<typename T>
+    T* allocate(size_t count){
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // Everything handed out before is invalid afterwards
+    void reset(){
+        if(blocks.size() > 1){
+            size_t total = 0;
+            for(auto& block: blocks){
+                total += block.size;
+            }
+            blocks.clear();
+            addBlock(total);
+        }
+
+        current = 0;
+        offset = 0;
+        usedBytes = 0;
+    }
+
+    size_t used() const {
+        return usedBytes;
+    }
+
+    size_t capacity() const {
+        size_t total = 0;
+        for(auto& block: blocks){
+            total += block.size;
+        }
+        return total;
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t usedBytes = 0;
+
+    std::byte* tryAllocate(size_t size, size_t alignment){
+        Block& block = blocks[current];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+        size_t aligned = alignUp(base + offset, alignment) - base;
+        if(aligned + size > block.size){
+            return nullptr;
+        }
+
+        offset = aligned + size;
+        return block.data.get() + aligned;
+    }
+
+    void addBlock(size_t size){
+        blocks.push_back({std::make_unique<std::byte[]>(size), size});
+    }
+
+    static size_t alignUp(size_t value, size_t alignment){
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+};
+
+// Lets standard containers live in a LinearArena. Deallocation does nothing, the memory comes back on reset(),
+// so a container must not outlive the arena's reset
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator(LinearArena& arena): arena(&arena) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other): arena(other.arena) {}
+
+    T* allocate(size_t count){
+        return arena->allocate<T>(count);
+    }
+
+    void deallocate(T*, size_t){}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+
+private:
+    template<typename U>
+    friend class ArenaAllocator;
+
+    LinearArena* arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
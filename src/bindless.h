@@ -0,0 +1,191 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+
+// One global descriptor set holding every sampled image, storage image and storage buffer in big arrays.
+// It's bound once per command buffer and shaders pick resources by the index passed in push constants.
+class BindlessTable {
+public:
+    static constexpr uint32_t SAMPLED_IMAGE_BINDING = 0;
+    static constexpr uint32_t STORAGE_IMAGE_BINDING = 1;
+    static constexpr uint32_t STORAGE_BUFFER_BINDING = 2;
+
+    static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+    VkDescriptorSetLayout layout;
+    VkDescriptorSet set;
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t maxSampledImages = 4096, uint32_t maxStorageImages = 256, uint32_t maxStorageBuffers = 4096){
+        this->device = device;
+
+        // stay inside what the device can put in one update-after-bind set
+        VkPhysicalDeviceVulkan12Properties properties12{};
+        properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &properties12;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        sampledImages.capacity = std::min({maxSampledImages, properties12.maxDescriptorSetUpdateAfterBindSampledImages, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages});
+        storageImages.capacity = std::min({maxStorageImages, properties12.maxDescriptorSetUpdateAfterBindStorageImages, properties12.maxPerStageDescriptorUpdateAfterBindStorageImages});
+        storageBuffers.capacity = std::min({maxStorageBuffers, properties12.maxDescriptorSetUpdateAfterBindStorageBuffers, properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+
+        DescriptorLayoutBuilder builder;
+        builder.addBinding(SAMPLED_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sampledImages.capacity);
+        builder.addBinding(STORAGE_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, storageImages.capacity);
+        builder.addBinding(STORAGE_BUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageBuffers.capacity);
+
+        // slots can be empty and can be written while the set is bound by frames in flight
+        VkDescriptorBindingFlags bindingFlags[3];
+        for(auto& flags: bindingFlags){
+            flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+        }
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = 3;
+        bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+        layout = builder.build(device, VK_SHADER_STAGE_ALL, &bindingFlagsInfo, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+
+        VkDescriptorPoolSize poolSizes[] = {
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sampledImages.capacity},
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, storageImages.capacity},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageBuffers.capacity}
+        };
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 3;
+        poolInfo.pPoolSizes = poolSizes;
+
+        VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool));
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &set));
+    }
+
+    void destroy(){
+        vkDestroyDescriptorPool(device, pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, layout, nullptr);
+    }
+
+    uint32_t addSampledImage(VkImageView view, VkSampler sampler, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL){
+        uint32_t index = sampledImages.acquire();
+        if(index != INVALID_INDEX){
+            writeSampledImage(index, view, sampler, imageLayout);
+        }
+        return index;
+    }
+
+    uint32_t addStorageImage(VkImageView view){
+        uint32_t index = storageImages.acquire();
+        if(index != INVALID_INDEX){
+            writeStorageImage(index, view);
+        }
+        return index;
+    }
+
+    uint32_t addStorageBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE){
+        uint32_t index = storageBuffers.acquire();
+        if(index != INVALID_INDEX){
+            writeStorageBuffer(index, buffer, offset, range);
+        }
+        return index;
+    }
+
+    // Slots can be rewritten in place, eg. when a render target is recreated
+    void writeSampledImage(uint32_t index, VkImageView view, VkSampler sampler, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL){
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.sampler = sampler;
+        imageInfo.imageView = view;
+        imageInfo.imageLayout = imageLayout;
+
+        write(SAMPLED_IMAGE_BINDING, index, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, nullptr);
+    }
+
+    void writeStorageImage(uint32_t index, VkImageView view){
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageView = view;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        write(STORAGE_IMAGE_BINDING, index, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &imageInfo, nullptr);
+    }
+
+    void writeStorageBuffer(uint32_t index, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE){
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = offset;
+        bufferInfo.range = range;
+
+        write(STORAGE_BUFFER_BINDING, index, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &bufferInfo);
+    }
+
+    // The slot must not be used by frames still in flight, free it from a per-frame deletion queue
+    void removeSampledImage(uint32_t index){ sampledImages.release(index); }
+    void removeStorageImage(uint32_t index){ storageImages.release(index); }
+    void removeStorageBuffer(uint32_t index){ storageBuffers.release(index); }
+
+    void bind(VkCommandBuffer command, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout){
+        vkCmdBindDescriptorSets(command, bindPoint, pipelineLayout, 0, 1, &set, 0, nullptr);
+    }
+
+private:
+    struct SlotList {
+        uint32_t capacity = 0;
+        uint32_t next = 0;
+        std::vector<uint32_t> freeSlots;
+
+        uint32_t acquire(){
+            if(!freeSlots.empty()){
+                uint32_t index = freeSlots.back();
+                freeSlots.pop_back();
+                return index;
+            }
+
+            if(next >= capacity){
+                fmt::println("Bindless table is full ({} slots)", capacity);
+                return INVALID_INDEX;
+            }
+            return next++;
+        }
+
+        void release(uint32_t index){
+            if(index != INVALID_INDEX){
+                freeSlots.push_back(index);
+            }
+        }
+    };
+
+    VkDevice device;
+    VkDescriptorPool pool;
+
+    SlotList sampledImages;
+    SlotList storageImages;
+    SlotList storageBuffers;
+
+    void write(uint32_t binding, uint32_t index, VkDescriptorType type, VkDescriptorImageInfo* imageInfo, VkDescriptorBufferInfo* bufferInfo){
+        VkWriteDescriptorSet writeInfo{};
+        writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeInfo.pNext = nullptr;
+
+        writeInfo.dstSet = set;
+        writeInfo.dstBinding = binding;
+        writeInfo.dstArrayElement = index;
+        writeInfo.descriptorCount = 1;
+        writeInfo.descriptorType = type;
+        writeInfo.pImageInfo = imageInfo;
+        writeInfo.pBufferInfo = bufferInfo;
+
+        vkUpdateDescriptorSets(device, 1, &writeInfo, 0, nullptr);
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "utils.h"
+
+// Fly camera. WASD moves, Q/E go down and up, holding the right mouse button looks around
+struct Camera {
+    glm::vec3 position{0.f, 0.f, 2.f};
+    float pitch = 0.f;      // radians, looking down -z at 0
+    float yaw = 0.f;
+    float fov = glm::radians(70.f);
+    float nearPlane = 0.1f;
+    float farPlane = 1000.f;
+    float speed = 2.f;                  // units per second
+    float sensitivity = 0.003f;         // radians per pixel
+
+    void update(GLFWwindow* window, float deltaTime){
+        double mouseX, mouseY;
+        glfwGetCursorPos(window, &mouseX, &mouseY);
+
+        if(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS && looking){
+            yaw -= static_cast<float>(mouseX - lastMouseX) * sensitivity;
+            pitch -= static_cast<float>(mouseY - lastMouseY) * sensitivity;
+            pitch = glm::clamp(pitch, -glm::radians(89.f), glm::radians(89.f));
+        }
+        looking = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+        lastMouseX = mouseX;
+        lastMouseY = mouseY;
+
+        glm::vec3 move{0.f};
+        if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) move.z -= 1.f;
+        if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) move.z += 1.f;
+        if(glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) move.x -= 1.f;
+        if(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) move.x += 1.f;
+        if(glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) move.y -= 1.f;
+        if(glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) move.y += 1.f;
+
+        if(move != glm::vec3(0.f)){
+            position += glm::vec3(rotationMatrix() * glm::vec4(glm::normalize(move), 0.f)) * speed * deltaTime;
+        }
+    }
+
+    glm::mat4 rotationMatrix() const {
+        glm::mat4 yawRotation = glm::rotate(glm::mat4(1.f), yaw, glm::vec3(0.f, 1.f, 0.f));
+        glm::mat4 pitchRotation = glm::rotate(glm::mat4(1.f), pitch, glm::vec3(1.f, 0.f, 0.f));
+        return yawRotation * pitchRotation;
+    }
+
+    glm::mat4 viewMatrix() const {
+        glm::mat4 translation = glm::translate(glm::mat4(1.f), position);
+        return glm::inverse(translation * rotationMatrix());
+    }
+
+    // Depth 0 to 1, y flipped for Vulkan's clip space
+    glm::mat4 projectionMatrix(float aspect) const {
+        glm::mat4 projection = glm::perspective(fov, aspect, nearPlane, farPlane);
+        projection[1][1] *= -1.f;
+        return projection;
+    }
+
+private:
+    bool looking = false;
+    double lastMouseX = 0.0;
+    double lastMouseY = 0.0;
+};
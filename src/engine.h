@@ -6,6 +6,22 @@
 #include "images.h"
 #include "structs.h"
 #include "pipelines.h"
+#include "pipelinecache.h"
+#include "pipelineregistry.h"
+#include "shadercache.h"
+#include "profiler.h"
+#include "framestats.h"
+#include "resolution.h"
+#include "jobs.h"
+#include "trace.h"
+#include "uploads.h"
+#include "bindless.h"
+#include "scene.h"
+#include "camera.h"
+#include "loader.h"
+#include "meshcache.h"
+#include "vertexformat.h"
+#include "textures.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -13,6 +29,9 @@
 
 class Engine {
 public:    
+    EngineOptions options;
+    FrameHistogram frameStats;
+
     GLFWwindow* window;
     VkInstance instance;
     VkDebugUtilsMessengerEXT debugMessenger;
@@ -24,33 +43,72 @@ public:
     bool resizeRequested = false;
     VkExtent2D windowExtent;
 
-    FrameData frames[FRAME_OVERLAP];
-    uint32_t frameNumber;
+    FrameData frames[MAX_FRAME_OVERLAP];
+    uint32_t frameOverlap = 0;      // frames[0, frameOverlap) are created, options.frameOverlap is what the UI asks for
+    uint32_t frameNumber{0};
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;    // what the swapchain was built with
     VkQueue graphicsQueue;
     uint32_t graphicsQueueFamily;
+    VkQueue transferQueue;
+    uint32_t transferQueueFamily;
     
     std::vector<VkImage> swapchainImages;
     std::vector<VkImageView> swapchainImageViews;
+
+    // headless mode renders into these instead of a swapchain, the images above point at them
+    std::vector<AllocatedImage> offscreenTargets;
+    AllocatedBuffer frameDumpBuffer;
     VkExtent2D swapchainExtent;
     VkFormat swapchainImageFormat;
 
     AllocatedImage drawImage;
     AllocatedImage depthImage;
-
-    VkExtent2D drawExtent;
+    uint32_t depthImageIndex;
+
+    // max depth of the previous frame at decreasing resolutions, used for occlusion culling
+    AllocatedImage depthPyramid;
+    VkExtent2D depthPyramidExtent;
+    uint32_t depthPyramidLevels;
+    std::vector<VkImageView> depthPyramidMips;
+    std::vector<uint32_t> depthPyramidMipIndices;  // bindless storage image of every level
+    uint32_t depthPyramidIndex;                     // bindless sampled image of the whole pyramid
+    bool depthPyramidReady = false;
+    VkSampler nearestSampler;
+
+    // Everything createRenderTargets makes, so a replaced set can be destroyed once no frame uses it
+    struct RenderTargets {
+        AllocatedImage drawImage;
+        AllocatedImage depthImage;
+        AllocatedImage depthPyramid;
+        std::vector<VkImageView> depthPyramidMips;
+        std::vector<uint32_t> storageIndices;
+        std::vector<uint32_t> sampledIndices;
+    };
+
+    VkExtent2D drawExtent;     // part of drawImage rendered this frame, the targets can be bigger than the window
 
     DeletionQueue mainDeletionQueue;
     DeletionQueue descriptorDeletionQueue;
     VmaAllocator allocator;
 
-    DescriptorAllocator globalDescriptorAllocator;
+    DescriptorAllocatorGrowable globalDescriptorAllocator;
+
+    BindlessTable bindless;
+    uint32_t drawImageStorageIndex;
 
-    VkDescriptorSet drawImageDescriptors;
-    VkDescriptorSetLayout drawImageDescriptorLayout;
+    PipelineCache pipelineCache;
+    PipelineRegistry pipelineRegistry;
+
+    ShaderCache shaderCache;   // only holds modules while setupPipeline runs
 
     VkPipeline gradientPipeline;
     VkPipelineLayout gradientPipelineLayout;
 
+    UploadQueue uploadQueue;
+
+    StagingRing frameStaging;
+    std::vector<PendingCopy> frameCopies;
+
     VkFence immediateFence;
     VkCommandBuffer immediateCommandBuffer;
     VkCommandPool immediateCommandPool;
@@ -61,77 +119,247 @@ public:
     VkPipelineLayout meshPipelineLayout;
     VkPipeline meshPipeline;
 
+    VkPipelineLayout cullPipelineLayout;
+    VkPipeline cullPipeline;
+    VkPipelineLayout depthReducePipelineLayout;
+    VkPipeline depthReducePipeline;
+    bool frustumCulling = true;
+    bool occlusionCulling = true;
+
     GPUMeshBuffers rectangle;
+    std::vector<std::shared_ptr<Loader::MeshAsset>> testMeshes;
+
+    SamplerCache samplerCache;
+    std::vector<std::shared_ptr<Texture>> textures;
+    std::vector<std::shared_ptr<Texture>> pendingTextures;     // uploaded, mips not generated yet
+    bool canBlitMips = false;      // the texture format supports linear blits, otherwise textures get one level
+    bool compressedTextures = false;    // textureCompressionBC, cooked BC textures fall back to their source image without it
+
+    std::vector<RenderObject> renderObjects;
+    bool sceneDirty = false;
+    SceneBuffers sceneBuffers;
+    SceneBuffers pendingSceneBuffers;   // rebuilt scene waiting for its upload
+    bool scenePending = false;
+
+    Camera camera;
+    GPUSceneData sceneData;
+    VkDeviceAddress sceneDataAddress = 0;   // this frame's copy of sceneData in its uniform ring
+    glm::mat4 prevViewProj{1.f};
+    bool hasPrevViewProj = false;
+
+    Jobs::WorkerPool workerPool;
+
+    GpuProfiler gpuProfiler;
+    ResolutionScaler resolutionScaler;
 
     std::vector<ComputeEffect> backgroundEffects;
     int currentBackgroundEffect{0};
 
     Engine(){}
 
+    Engine(const EngineOptions& options) : options(options), frameStats(options.frameBudget) {}
+
     void init(){
-        setupWindow();
+        if(!options.tracePath.empty()){
+            Trace::start();
+        }
+        Trace::setThreadName("Main");
+
+        workerPool.start();
+
+        if(!options.headless){
+            setupWindow();
+        }
         setupVulkan();
         setupSwapchain();
         setupCommandResources();
         setupSyncStructures();
+        setupProfiler();
+        setupFrames();
+        setupUploadQueue();
+        setupBindless();
+        setupRenderTargets();
         setupDescriptors();
+        setupPipelineCache();
         setupPipeline();
         setupDefaultRectangleData();
-        setupImgui();
+        setupDefaultMeshes();
+        setupDefaultTextures();
+
+        if(!options.headless){
+            setupImgui();
+        }
     }
 
     void run(){
-        double totalFrameTime = 0.0;
         int frameCount = 0;
         auto startTime = std::chrono::high_resolution_clock::now();
 
-        while(!glfwWindowShouldClose(window)){
+        while(keepRunning(frameCount)){
+            Trace::Zone frameZone("Frame");
             auto frameStartTime = std::chrono::high_resolution_clock::now();
 
-            glfwPollEvents();
+            applyFrameSettings();
 
-            if(resizeRequested){
-                resizeSwapchain();
-            }
-
-            ImGui_ImplGlfw_NewFrame();
-            ImGui_ImplVulkan_NewFrame();
-            ImGui::NewFrame();
+            if(!options.headless){
+                {
+                    Trace::Zone zone("Poll events");
+                    glfwPollEvents();
+                }
 
-            if(ImGui::Begin("Background")) {
-                ComputeEffect& selected = backgroundEffects[currentBackgroundEffect];
+                if(resizeRequested){
+                    Trace::Zone zone("Resize");
+                    resizeSwapchain();
+                }
 
-                ImGui::Text("Selected Effect: ", selected.name);
+                Trace::Zone zone("UI");
+                drawUi();
 
-                ImGui::SliderInt("Effect Index", &currentBackgroundEffect, 0, backgroundEffects.size() - 1);
-
-                ImGui::InputFloat4("data1", (float*)& selected.data.data1);
-                ImGui::InputFloat4("data2", (float*)& selected.data.data2);
-                ImGui::InputFloat4("data3", (float*)& selected.data.data3);
-                ImGui::InputFloat4("data4", (float*)& selected.data.data4);
+                if(!ImGui::GetIO().WantCaptureMouse && !ImGui::GetIO().WantCaptureKeyboard){
+                    camera.update(window, static_cast<float>(lastFrameTime / 1000.0));
+                }
             }
-            ImGui::End();
-
-            ImGui::Render();
 
             draw();
 
             auto frameEndTime = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double, std::milli> frameDuration = frameEndTime - frameStartTime;
 
-            totalFrameTime += frameDuration.count();
+            frameStats.record(frameDuration.count());
+            lastFrameTime = frameDuration.count();
             frameCount++;
         }
 
         auto endTime = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> elapsedSeconds = endTime - startTime;
-        double averageFrameTime = totalFrameTime / frameCount;
-        double fps = 1000.0 / averageFrameTime;
+        FrameHistogram::Summary stats = frameStats.summary();
+        double fps = stats.average > 0.0 ? 1000.0 / stats.average : 0.0;
 
         fmt::println("Total elapsed time: {} seconds", elapsedSeconds.count());
         fmt::println("Total frames: {}", frameCount);
-        fmt::println("Average frame time: {}ms", averageFrameTime);
+        fmt::println("Average frame time: {}ms", stats.average);
         fmt::println("Average FPS: {}", fps);
+        fmt::println("Frame time p50 {:.2f}ms p90 {:.2f}ms p99 {:.2f}ms p99.9 {:.2f}ms max {:.2f}ms", stats.p50, stats.p90, stats.p99, stats.p999, stats.max);
+        fmt::println("Frames over {:.2f}ms budget: {} ({:.2f}%)", stats.budget, stats.overBudget, stats.frames > 0 ? 100.0 * stats.overBudget / stats.frames : 0.0);
+
+        if(options.dynamicResolution){
+            fmt::println("Final resolution scale: {:.2f}", resolutionScaler.scale());
+        }
+
+        if(!options.statsPath.empty()){
+            frameStats.write(options.statsPath);
+        }
+
+        for (uint32_t i = 0; i < GpuProfiler::PASS_COUNT; i++)
+        {
+            GpuPass pass = static_cast<GpuPass>(i);
+            GpuProfiler::Stats stats = gpuProfiler.stats(pass);
+            if(stats.samples > 0){
+                fmt::println("GPU {}: min {:.3f}ms avg {:.3f}ms p99 {:.3f}ms", GpuProfiler::passName(pass), stats.min, stats.avg, stats.p99);
+            }
+        }
+    }
+
+    bool keepRunning(int frameCount){
+        if(options.frameCount > 0 && frameCount >= static_cast<int>(options.frameCount)){
+            return false;
+        }
+        return options.headless || !glfwWindowShouldClose(window);
+    }
+
+    void drawUi(){
+        ImGui_ImplGlfw_NewFrame();
+        ImGui_ImplVulkan_NewFrame();
+        ImGui::NewFrame();
+
+        if(ImGui::Begin("Background")) {
+            ComputeEffect& selected = backgroundEffects[currentBackgroundEffect];
+
+            ImGui::Text("Selected Effect: ", selected.name);
+
+            ImGui::SliderInt("Effect Index", &currentBackgroundEffect, 0, backgroundEffects.size() - 1);
+
+            ImGui::InputFloat4("data1", (float*)& selected.data.data1);
+            ImGui::InputFloat4("data2", (float*)& selected.data.data2);
+            ImGui::InputFloat4("data3", (float*)& selected.data.data3);
+            ImGui::InputFloat4("data4", (float*)& selected.data.data4);
+        }
+        ImGui::End();
+
+        if(ImGui::Begin("Culling")){
+            ImGui::Checkbox("Frustum culling", &frustumCulling);
+            ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+        }
+        ImGui::End();
+
+        if(ImGui::Begin("Textures")){
+            ImGui::Text("%zu loaded, %zu waiting for upload, %zu samplers", textures.size() - pendingTextures.size(), pendingTextures.size(), samplerCache.size());
+        }
+        ImGui::End();
+
+        if(ImGui::Begin("Frame times")){
+            FrameHistogram::Summary stats = frameStats.summary();
+            std::array<float, FrameHistogram::RECENT_COUNT> recent = frameStats.recentFrames();
+
+            // scale so the budget line sits in the middle unless something is slower
+            float scaleMax = std::max(static_cast<float>(stats.budget * 2.0), *std::max_element(recent.begin(), recent.end()));
+            ImGui::PlotLines("##frames", recent.data(), static_cast<int>(recent.size()), 0, nullptr, 0.f, scaleMax, ImVec2(0, 80));
+
+            ImGui::Text("p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f ms", stats.p50, stats.p90, stats.p99, stats.p999, stats.max);
+            ImGui::Text("Over %.2f ms budget: %llu of %llu frames", stats.budget, static_cast<unsigned long long>(stats.overBudget), static_cast<unsigned long long>(stats.frames));
+
+            if(ImGui::Checkbox("Dynamic resolution", &options.dynamicResolution)){
+                resolutionScaler.reset();
+            }
+            if(options.dynamicResolution){
+                ImGui::SliderFloat("Min scale", &resolutionScaler.minScale, 0.25f, 1.f);
+                ImGui::Text("Scale %.2f (%ux%u), GPU %.2f ms", resolutionScaler.scale(), drawExtent.width, drawExtent.height, resolutionScaler.smoothedTime());
+            }
+
+            // picked here, applied before the next frame starts
+            int overlap = static_cast<int>(options.frameOverlap);
+            if(ImGui::SliderInt("Frames in flight", &overlap, 1, static_cast<int>(MAX_FRAME_OVERLAP))){
+                options.frameOverlap = static_cast<uint32_t>(overlap);
+            }
+
+            if(ImGui::BeginCombo("Present mode", string_VkPresentModeKHR(options.presentMode))){
+                for(auto& mode: PRESENT_MODES){
+                    if(ImGui::Selectable(mode.name, mode.mode == options.presentMode)){
+                        options.presentMode = mode.mode;
+                    }
+                }
+                ImGui::EndCombo();
+            }
+        }
+        ImGui::End();
+
+        if(ImGui::Begin("GPU timings")){
+            if(!gpuProfiler.isEnabled()){
+                ImGui::Text("Timestamps not supported");
+            } else if(ImGui::BeginTable("passes", 4)){
+                ImGui::TableSetupColumn("Pass");
+                ImGui::TableSetupColumn("Min (ms)");
+                ImGui::TableSetupColumn("Avg (ms)");
+                ImGui::TableSetupColumn("P99 (ms)");
+                ImGui::TableHeadersRow();
+
+                for (uint32_t i = 0; i < GpuProfiler::PASS_COUNT; i++)
+                {
+                    GpuPass pass = static_cast<GpuPass>(i);
+                    GpuProfiler::Stats stats = gpuProfiler.stats(pass);
+
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn(); ImGui::Text("%s", GpuProfiler::passName(pass));
+                    ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.min);
+                    ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.avg);
+                    ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.p99);
+                }
+                ImGui::EndTable();
+            }
+        }
+        ImGui::End();
+
+        ImGui::Render();
     }
 
     void immediateSubmit(std::function<void(VkCommandBuffer command)>&& function){
@@ -156,89 +384,210 @@ public:
     void cleanup(){
         vkDeviceWaitIdle(device);
 
-        for (size_t i = 0; i < FRAME_OVERLAP; i++)
-        {
-            vkDestroyCommandPool(device, frames[i].commandPool, nullptr);
+        destroySceneBuffers(sceneBuffers);
+        destroySceneBuffers(pendingSceneBuffers);
 
-            vkDestroyFence(device, frames[i].renderFence, nullptr);
-            vkDestroySemaphore(device, frames[i].renderSemaphore, nullptr);
-            vkDestroySemaphore(device, frames[i].swapchainSemaphore, nullptr);
+        for (size_t i = 0; i < frameOverlap; i++)
+        {
+            destroyFrameResources(frames[i]);
         }
         
+        // offscreen targets in headless mode are VMA images, so this goes before the allocator
+        destroySwapchain();
+
         mainDeletionQueue.flush();
         descriptorDeletionQueue.flush();
 
-        destroySwapchain();
-
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        if(!options.headless){
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
         vkDestroyDevice(device, nullptr);
         
         vkb::destroy_debug_utils_messenger(instance, debugMessenger);
         vkDestroyInstance(instance, nullptr);
-        cleanupWindow();
+
+        if(!options.headless){
+            cleanupWindow();
+        }
+
+        workerPool.stop();
+
+        if(!options.tracePath.empty()){
+            Trace::stop();
+            Trace::write(options.tracePath);
+        }
     }
 
 private:
     double FPS;
+    double lastFrameTime = 0.0;     // milliseconds, moves the camera
 
     void draw(){
-        VK_CHECK(vkWaitForFences(device, 1, &getCurrentFrame().renderFence, VK_TRUE, 1000000000)); // timeout of 1 second
+        {
+            Trace::Zone zone("Fence wait");
+            VK_CHECK(vkWaitForFences(device, 1, &getCurrentFrame().renderFence, VK_TRUE, 1000000000)); // timeout of 1 second
+        }
 
         getCurrentFrame().deletionQueue.flush();
+        getCurrentFrame().frameDescriptors.clearPools(device);
+        getCurrentFrame().arena.reset();
+        getCurrentFrame().uniforms.reset();
+        if(gpuProfiler.collect(getCurrentFrame()) && options.dynamicResolution){
+            resolutionScaler.update(gpuProfiler.frameTime(), static_cast<float>(options.frameBudget));
+        }
 
-        VK_CHECK(vkResetFences(device, 1, &getCurrentFrame().renderFence));
+        // staging written by the frame that last used this slot is free again
+        if(frameNumber + 1 >= frameOverlap){
+            frameStaging.ring.retire(frameNumber + 1 - frameOverlap);
+        }
 
         uint32_t swapchainImageIndex;
-        if(vkAcquireNextImageKHR(device, swapchain, 1000000000, getCurrentFrame().swapchainSemaphore, nullptr, &swapchainImageIndex) == VK_ERROR_OUT_OF_DATE_KHR){
-            resizeRequested = true;
-            return;
+        if(options.headless){
+            // one offscreen target per frame in flight, the fence above already freed this one
+            swapchainImageIndex = frameNumber % swapchainImages.size();
+        } else {
+            Trace::Zone zone("Acquire");
+            VkResult result = vkAcquireNextImageKHR(device, swapchain, 1000000000, getCurrentFrame().swapchainSemaphore, nullptr, &swapchainImageIndex);
+            // nothing of this frame has been queued yet, so a retry next frame starts clean
+            if(result == VK_ERROR_OUT_OF_DATE_KHR){
+                resizeRequested = true;
+                return;
+            }
+            if(result == VK_SUBOPTIMAL_KHR){
+                resizeRequested = true;
+            } else {
+                VK_CHECK(result);
+            }
+        }
+
+        // submit whatever was queued for upload since last frame
+        {
+            Trace::Zone zone("Uploads");
+            uploadQueue.flush();
+
+            updateScene();
         }
 
+        // only reset once something will be submitted, a skipped frame must leave its fence signalled
+        VK_CHECK(vkResetFences(device, 1, &getCurrentFrame().renderFence));
+
+        bool dumpFrame = options.headless && !options.dumpPath.empty() && frameNumber % options.dumpInterval == 0;
+
+        Trace::Zone recordZone("Record");
+
         VkCommandBuffer command = getCurrentFrame().mainCommandBuffer;
 
         VK_CHECK(vkResetCommandBuffer(command, 0));
 
-        // Set DrawExtent
-        drawExtent.width = drawImage.imageExtent.width;
-        drawExtent.height = drawImage.imageExtent.height;
+        // Set DrawExtent, the blit to the swapchain scales it back up
+        drawExtent.width = std::min(swapchainExtent.width, drawImage.imageExtent.width);
+        drawExtent.height = std::min(swapchainExtent.height, drawImage.imageExtent.height);
+        if(options.dynamicResolution){
+            drawExtent = resolutionScaler.extent(drawExtent);
+        }
+
+        updateSceneData();
 
         VkCommandBufferBeginInfo beginInfo = Initializers::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
         VK_CHECK(vkBeginCommandBuffer(command, &beginInfo));
 
+        gpuProfiler.beginFrame(command, getCurrentFrame());
+
+        recordFrameCopies(command);
+        finishTextures(command);
+
+        // every pipeline shares set 0, so this is the only descriptor bind of the frame
+        bindless.bind(command, VK_PIPELINE_BIND_POINT_COMPUTE, gradientPipelineLayout);
+        bindless.bind(command, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout);
+
+        // staging recorded above is retired once this frame's fence has been waited on
+        frameStaging.ring.close(frameNumber + 1);
+
         // Transition to general layout so we can draw to it
         Utility::transitionImage(command, drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
         // Draw to drawImage.image
+        gpuProfiler.begin(command, GpuPass::Background);
         drawBackground(command);
+        gpuProfiler.end(command, GpuPass::Background);
+
+        gpuProfiler.begin(command, GpuPass::Culling);
+        cullScene(command);
+        gpuProfiler.end(command, GpuPass::Culling);
 
         Utility::transitionImage(command, drawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
         Utility::transitionImage(command, depthImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 
+        gpuProfiler.begin(command, GpuPass::Geometry);
         drawGeometry(command);
+        gpuProfiler.end(command, GpuPass::Geometry);
+
+        gpuProfiler.begin(command, GpuPass::DepthPyramid);
+        buildDepthPyramid(command);
+        gpuProfiler.end(command, GpuPass::DepthPyramid);
 
         // Transition drawImage to src optimal and swapchain to dst optimal
         Utility::transitionImage(command, drawImage.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
         Utility::transitionImage(command, swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
         // Copies drawImage to swapchainImage
+        gpuProfiler.begin(command, GpuPass::Blit);
         Utility::copyImageToImage(command, drawImage.image, swapchainImages[swapchainImageIndex], drawExtent, swapchainExtent);
-        // Transition swapchain to present
-        Utility::transitionImage(command, swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        gpuProfiler.end(command, GpuPass::Blit);
+        if(options.headless){
+            Utility::transitionImage(command, swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+            if(dumpFrame){
+                recordFrameDump(command, swapchainImages[swapchainImageIndex]);
+            }
+        } else {
+            // Transition swapchain to present
+            Utility::transitionImage(command, swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
-        drawImgui(command, swapchainImageViews[swapchainImageIndex]);
+            gpuProfiler.begin(command, GpuPass::Imgui);
+            drawImgui(command, swapchainImageViews[swapchainImageIndex]);
+            gpuProfiler.end(command, GpuPass::Imgui);
 
-        Utility::transitionImage(command, swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+            Utility::transitionImage(command, swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        }
 
         VK_CHECK(vkEndCommandBuffer(command));
+        recordZone.end();
+
+        Trace::Zone submitZone("Submit");
 
         VkCommandBufferSubmitInfo commandInfo = Initializers::commandBufferSubmitInfo(command);
 
-        VkSemaphoreSubmitInfo waitInfo = Initializers::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, getCurrentFrame().swapchainSemaphore);
+        VkSemaphoreSubmitInfo waitInfos[2];
+        uint32_t waitCount = 0;
+
+        if(!options.headless){
+            waitInfos[waitCount++] = Initializers::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, getCurrentFrame().swapchainSemaphore);
+        }
+
+        // only uploads already seen as finished are drawn with, so this wait never stalls the queue
+        waitInfos[waitCount] = Initializers::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, uploadQueue.timeline);
+        waitInfos[waitCount].value = uploadQueue.completedValue();
+        waitCount++;
+
+        // nothing presents in headless mode, so nothing would wait on the render semaphore
         VkSemaphoreSubmitInfo signalInfo = Initializers::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, getCurrentFrame().renderSemaphore);
 
-        VkSubmitInfo2 submitInfo = Initializers::submitInfo(&commandInfo, &signalInfo, &waitInfo);
+        VkSubmitInfo2 submitInfo = Initializers::submitInfo(&commandInfo, options.headless ? nullptr : &signalInfo, &waitInfos[0]);
+        submitInfo.waitSemaphoreInfoCount = waitCount;
 
         VK_CHECK(vkQueueSubmit2(graphicsQueue, 1, &submitInfo, getCurrentFrame().renderFence));
+        submitZone.end();
+
+        if(options.headless){
+            if(dumpFrame){
+                Trace::Zone zone("Frame dump");
+                writeFrameDump();
+            }
+
+            frameNumber++;
+            return;
+        }
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -250,9 +599,12 @@ private:
         presentInfo.pWaitSemaphores = &getCurrentFrame().renderSemaphore;
 
         presentInfo.pImageIndices = &swapchainImageIndex;
+
+        Trace::Zone presentZone("Present");
         if(vkQueuePresentKHR(graphicsQueue, &presentInfo) == VK_ERROR_OUT_OF_DATE_KHR){
             resizeRequested = true;
         }
+        presentZone.end();
 
         frameNumber++;
     }
@@ -275,7 +627,9 @@ private:
 
     void setupVulkan(){
         vkb::Instance vkb_instance = setupInstanceAndDebugMessenger();
-        setupSurface();
+        if(!options.headless){
+            setupSurface();
+        }
         setupPhysicalDevice(vkb_instance);
 
         VmaAllocatorCreateInfo allocatorInfo{};
@@ -284,6 +638,7 @@ private:
         allocatorInfo.instance = instance;
         allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
         vmaCreateAllocator(&allocatorInfo, &allocator);
+        mainDeletionQueue.init(device, allocator);
 
         mainDeletionQueue.pushFunction([&]() {
             vmaDestroyAllocator(allocator);
@@ -297,6 +652,7 @@ private:
                                             .request_validation_layers(USE_VALIDATION_LAYERS)
                                             .use_default_debug_messenger()
                                             .require_api_version(1, 3, 0)
+                                            .set_headless(options.headless)
                                             .build();
 
         vkb::Instance vkb_instance = instance_return_option.value();
@@ -314,24 +670,56 @@ private:
     }
 
     void setupPhysicalDevice(vkb::Instance vkb_instance){
-        VkPhysicalDeviceVulkan13Features features;
+        VkPhysicalDeviceVulkan13Features features{};
         features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
         features.dynamicRendering = VK_TRUE;
         features.synchronization2 = VK_TRUE;
 
-        VkPhysicalDeviceVulkan12Features features12;
+        VkPhysicalDeviceVulkan12Features features12{};
         features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
         features12.bufferDeviceAddress = VK_TRUE;
         features12.descriptorIndexing = VK_TRUE;
+        features12.timelineSemaphore = VK_TRUE;
+
+        // bindless table
+        features12.runtimeDescriptorArray = VK_TRUE;
+        features12.descriptorBindingPartiallyBound = VK_TRUE;
+        features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        features12.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+        features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+        // culling pass writes the draw counts
+        features12.drawIndirectCount = VK_TRUE;
+
+        // indirect scene rendering, gl_InstanceIndex picks the object through firstInstance
+        VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.multiDrawIndirect = VK_TRUE;
+        deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
 
         vkb::PhysicalDeviceSelector selector{vkb_instance};
-        vkb::PhysicalDevice vkb_physicalDevice = selector
-                                                .set_minimum_version(1, 3)
-                                                .set_required_features_13(features)
-                                                .set_required_features_12(features12)
-                                                .set_surface(surface)
-                                                .select()
-                                                .value();
+        selector.set_minimum_version(1, 3)
+                .set_required_features(deviceFeatures)
+                .set_required_features_13(features)
+                .set_required_features_12(features12);
+
+        // headless picks any device that can render, software drivers like lavapipe included
+        if(!options.headless){
+            selector.set_surface(surface);
+        }
+
+        auto selected = selector.select();
+        if(!selected){
+            fmt::println("No suitable GPU: {}", selected.error().message());
+            abort();
+        }
+
+        vkb::PhysicalDevice vkb_physicalDevice = selected.value();
+
+        // cooked textures are block compressed, the source images are loaded instead when this is missing
+        VkPhysicalDeviceFeatures compressionFeatures{};
+        compressionFeatures.textureCompressionBC = VK_TRUE;
+        compressedTextures = vkb_physicalDevice.enable_features_if_present(compressionFeatures);
 
         vkb::DeviceBuilder deviceBuilder{vkb_physicalDevice};
 
@@ -342,69 +730,40 @@ private:
 
         graphicsQueue = vkb_device.get_queue(vkb::QueueType::graphics).value();
         graphicsQueueFamily = vkb_device.get_queue_index(vkb::QueueType::graphics).value();
+
+        // uploads go on a dedicated transfer queue when the device has one
+        auto dedicatedTransfer = vkb_device.get_dedicated_queue(vkb::QueueType::transfer);
+        if(dedicatedTransfer.has_value()){
+            transferQueue = dedicatedTransfer.value();
+            transferQueueFamily = vkb_device.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+        } else {
+            transferQueue = graphicsQueue;
+            transferQueueFamily = graphicsQueueFamily;
+        }
     }
 
     void setupSwapchain(){
         createSwapchain(WIDTH, HEIGHT);
+    }
 
-        VkExtent3D drawImageExtent = {
-            swapchainExtent.width,
-            swapchainExtent.height
-        };
-
-        drawImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-        drawImage.imageExtent = drawImageExtent;
-
-        VkImageUsageFlags drawImageUsage{};
-        drawImageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-        drawImageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-        drawImageUsage |= VK_IMAGE_USAGE_STORAGE_BIT;
-        drawImageUsage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-
-        VkImageCreateInfo rimageInfo = Initializers::imageCreateInfo(drawImage.imageFormat, drawImageUsage, drawImageExtent);
-
-        VmaAllocationCreateInfo rimageAllocInfo{};
-        rimageAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-        rimageAllocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        VK_CHECK(vmaCreateImage(allocator, &rimageInfo, &rimageAllocInfo, &drawImage.image, &drawImage.allocation, nullptr));
-
-        VkImageViewCreateInfo rviewInfo = Initializers::imageViewCreateInfo(drawImage.imageFormat, drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
-
-        VK_CHECK(vkCreateImageView(device, &rviewInfo, nullptr, &drawImage.imageView));
-
-        depthImage.imageFormat = VK_FORMAT_D32_SFLOAT;
-        depthImage.imageExtent = drawImageExtent;
-
-        VkImageUsageFlags depthImageUsages{};
-        depthImageUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-
-        VkImageCreateInfo dImageInfo = Initializers::imageCreateInfo(depthImage.imageFormat, depthImageUsages, drawImageExtent);
-
-        vmaCreateImage(allocator, &dImageInfo, &rimageAllocInfo, &depthImage.image, &depthImage.allocation, nullptr); 
-
-        VkImageViewCreateInfo dviewInfo = Initializers::imageViewCreateInfo(depthImage.imageFormat, depthImage.image, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-        VK_CHECK(vkCreateImageView(device, &dviewInfo, nullptr, &depthImage.imageView));
+    void createSwapchain(int width, int height, VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE){
+        swapchainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
 
-        mainDeletionQueue.pushFunction([=](){
-            vkDestroyImageView(device, drawImage.imageView, nullptr);
-            vmaDestroyImage(allocator, drawImage.image, drawImage.allocation);
+        if(options.headless){
+            createOffscreenTargets(width, height);
+            return;
+        }
 
-            vkDestroyImageView(device, depthImage.imageView, nullptr);
-            vmaDestroyImage(allocator, depthImage.image, depthImage.allocation);
-        });
-    }
+        presentMode = choosePresentMode(options.presentMode);
+        options.presentMode = presentMode;
 
-    void createSwapchain(int width, int height){
         vkb::SwapchainBuilder builder{physicalDevice, device, surface};
 
-        swapchainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
-
         vkb::Swapchain vkb_swapchain = builder
                                         .set_desired_format(VkSurfaceFormatKHR{.format = swapchainImageFormat, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR})
-                                        .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+                                        .set_desired_present_mode(presentMode)
                                         .set_desired_extent(width, height)
+                                        .set_old_swapchain(oldSwapchain)
                                         .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
                                         .build()
                                         .value();
@@ -415,7 +774,27 @@ private:
         swapchainImageViews = vkb_swapchain.get_image_views().value();
     }
 
+    // FIFO is the only mode every device has to support, anything else falls back to it
+    VkPresentModeKHR choosePresentMode(VkPresentModeKHR desired){
+        uint32_t count = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, nullptr);
+        std::vector<VkPresentModeKHR> supported(count);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, supported.data());
+
+        if(std::find(supported.begin(), supported.end(), desired) != supported.end()){
+            return desired;
+        }
+
+        fmt::println("Present mode {} isn't supported, using FIFO", string_VkPresentModeKHR(desired));
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
     void destroySwapchain(){
+        if(options.headless){
+            destroyOffscreenTargets();
+            return;
+        }
+
         vkDestroySwapchainKHR(device, swapchain, nullptr);
 
         for (size_t i = 0; i < swapchainImageViews.size(); i++)
@@ -425,41 +804,123 @@ private:
         
     }
 
-    void resizeSwapchain(){
-        vkDeviceWaitIdle(device);
+    // Stand-ins for swapchain images when there is no window, one per frame in flight
+    void createOffscreenTargets(uint32_t width, uint32_t height){
+        swapchainExtent = {width, height};
 
-        destroySwapchain();
-        descriptorDeletionQueue.flush();
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        // enough for any frames in flight setting, so changing it doesn't need new targets
+        offscreenTargets.resize(MAX_FRAME_OVERLAP);
+        for(auto& target: offscreenTargets){
+            target.imageFormat = swapchainImageFormat;
+            target.imageExtent = {width, height, 1};
+
+            VkImageCreateInfo imageInfo = Initializers::imageCreateInfo(target.imageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, target.imageExtent);
+            VK_CHECK(vmaCreateImage(allocator, &imageInfo, &allocInfo, &target.image, &target.allocation, nullptr));
+
+            VkImageViewCreateInfo viewInfo = Initializers::imageViewCreateInfo(target.imageFormat, target.image, VK_IMAGE_ASPECT_COLOR_BIT);
+            VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &target.imageView));
+
+            swapchainImages.push_back(target.image);
+            swapchainImageViews.push_back(target.imageView);
+        }
+
+        if(!options.dumpPath.empty()){
+            std::filesystem::create_directories(options.dumpPath);
+            frameDumpBuffer = createBuffer(static_cast<size_t>(width) * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+        }
+    }
+
+    void destroyOffscreenTargets(){
+        for(auto& target: offscreenTargets){
+            vkDestroyImageView(device, target.imageView, nullptr);
+            vmaDestroyImage(allocator, target.image, target.allocation);
+        }
+        offscreenTargets.clear();
+        swapchainImages.clear();
+        swapchainImageViews.clear();
+
+        if(!options.dumpPath.empty()){
+            destroyBuffer(frameDumpBuffer);
+        }
+    }
 
+    void recordFrameDump(VkCommandBuffer command, VkImage image){
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {swapchainExtent.width, swapchainExtent.height, 1};
+
+        vkCmdCopyImageToBuffer(command, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frameDumpBuffer.buffer, 1, &region);
+    }
+
+    // Only called for dumped frames, so waiting on the fence here doesn't slow down plain benchmark runs
+    void writeFrameDump(){
+        VK_CHECK(vkWaitForFences(device, 1, &getCurrentFrame().renderFence, VK_TRUE, 9999999999));
+        VK_CHECK(vmaInvalidateAllocation(allocator, frameDumpBuffer.allocation, 0, VK_WHOLE_SIZE));
+
+        std::filesystem::path path = std::filesystem::path(options.dumpPath) / fmt::format("frame_{:05}.ppm", frameNumber);
+        if(!Utility::writePPM(path, static_cast<const uint8_t*>(frameDumpBuffer.info.pMappedData), swapchainExtent.width, swapchainExtent.height)){
+            fmt::println("Failed to write {}", path.string());
+        }
+    }
+
+    // Nothing waits for the device here, whatever frames in flight may still use is retired instead
+    void resizeSwapchain(){
         int width, height;
-        glfwGetWindowSize(window, &width, &height);
-        
+        glfwGetFramebufferSize(window, &width, &height);
+
+        // minimized, try again once the window has a size
+        if(width == 0 || height == 0){
+            return;
+        }
+
         windowExtent.width = width;
         windowExtent.height = height;
 
-        createSwapchain(windowExtent.width, windowExtent.height);
-        setupDescriptors();
+        VkSwapchainKHR oldSwapchain = swapchain;
+        std::vector<VkImageView> oldImageViews = swapchainImageViews;
+
+        createSwapchain(windowExtent.width, windowExtent.height, oldSwapchain);
+
+        retire([=, this](){
+            for(auto view: oldImageViews){
+                vkDestroyImageView(device, view, nullptr);
+            }
+            vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+        });
+
+        // render targets only grow, a smaller window renders into part of them
+        if(swapchainExtent.width > drawImage.imageExtent.width || swapchainExtent.height > drawImage.imageExtent.height){
+            RenderTargets oldTargets = currentRenderTargets();
+            retire([=, this](){
+                destroyRenderTargets(oldTargets);
+            });
+
+            createRenderTargets({std::max(swapchainExtent.width, drawImage.imageExtent.width), std::max(swapchainExtent.height, drawImage.imageExtent.height)});
+        }
+
+        // last frame's pyramid was built for the old viewport
+        depthPyramidReady = false;
 
         resizeRequested = false;
-        
+    }
+
+    // Runs once every frame submitted so far has finished, the frame slot used last is the one waited on next
+    void retire(std::function<void()>&& function){
+        frames[(frameNumber + frameOverlap - 1) % frameOverlap].deletionQueue.pushFunction(std::move(function));
     }
 
     FrameData& getCurrentFrame() {
-        return frames[frameNumber % FRAME_OVERLAP];
+        return frames[frameNumber % frameOverlap];
     }
 
     void setupCommandResources(){
         VkCommandPoolCreateInfo createInfo = Initializers::commandPoolCreateInfo(graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT)
 ;
-        for (size_t i = 0; i < FRAME_OVERLAP; i++)
-        {
-            VK_CHECK(vkCreateCommandPool(device, &createInfo, nullptr, &frames[i].commandPool));
-
-            VkCommandBufferAllocateInfo allocInfo = Initializers::commandBufferAllocateInfo(frames[i].commandPool, 1);
-
-            VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &frames[i].mainCommandBuffer));
-        }
-        
         VK_CHECK(vkCreateCommandPool(device, &createInfo, nullptr, &immediateCommandPool));
 
         VkCommandBufferAllocateInfo commandAllocInfo = Initializers::commandBufferAllocateInfo(immediateCommandPool, 1);
@@ -472,74 +933,408 @@ private:
 
     }
 
-    void setupSyncStructures(){
-        VkFenceCreateInfo fenceCreateInfo = Initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-        VkSemaphoreCreateInfo semaphoreCreateInfo = Initializers::semaphoreCreateInfo();
-
-        for (size_t i = 0; i < FRAME_OVERLAP; i++)
-        {
-            VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &frames[i].renderFence));
+    void setupProfiler(){
+        gpuProfiler.init(device, physicalDevice, graphicsQueueFamily);
 
-            VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frames[i].swapchainSemaphore));
-            VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frames[i].renderSemaphore));
+        if(options.dynamicResolution && !gpuProfiler.isEnabled()){
+            fmt::println("Dynamic resolution needs GPU timestamps, rendering at full resolution");
         }
+    }
 
-        VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &immediateFence));
-        mainDeletionQueue.pushFunction([=](){
-            vkDestroyFence(device, immediateFence, nullptr);
-        });
+    // Everything a frame in flight owns. Frames are destroyed in cleanup() rather than through mainDeletionQueue,
+    // since changing the number of frames in flight recreates them
+    void setupFrames(){
+        frameOverlap = std::clamp(options.frameOverlap, 1u, MAX_FRAME_OVERLAP);
+        options.frameOverlap = frameOverlap;
+
+        for (size_t i = 0; i < frameOverlap; i++)
+        {
+            createFrameResources(frames[i]);
+        }
     }
 
-    void drawBackground(VkCommandBuffer command){
-        ComputeEffect& effect = backgroundEffects[currentBackgroundEffect];
+    void createFrameResources(FrameData& frame){
+        frame.deletionQueue.init(device, allocator);
 
-        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
-        vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_COMPUTE, gradientPipelineLayout, 0, 1, &drawImageDescriptors, 0, nullptr);
+        VkCommandPoolCreateInfo poolInfo = Initializers::commandPoolCreateInfo(graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+        VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &frame.commandPool));
 
-        vkCmdPushConstants(command, gradientPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &effect.data);
-        vkCmdDispatch(command, std::ceil(drawExtent.width/16.0), std::ceil(drawExtent.height/16.0), 1);
-    }
+        VkCommandBufferAllocateInfo allocInfo = Initializers::commandBufferAllocateInfo(frame.commandPool, 1);
+        VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &frame.mainCommandBuffer));
 
-    void setupDescriptors(){
-        std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
-            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1}
-        };
+        VkFenceCreateInfo fenceCreateInfo = Initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+        VkSemaphoreCreateInfo semaphoreCreateInfo = Initializers::semaphoreCreateInfo();
 
-        globalDescriptorAllocator.initPool(device, 10, sizes);
+        VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &frame.renderFence));
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frame.swapchainSemaphore));
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frame.renderSemaphore));
 
-        {
-            DescriptorLayoutBuilder builder;
-            builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-            drawImageDescriptorLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
-        }
+        // transient sets, thrown away every frame
+        std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> frameSizes = {
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4}
+        };
 
-        drawImageDescriptors = globalDescriptorAllocator.allocate(device, drawImageDescriptorLayout);
+        frame.frameDescriptors = DescriptorAllocatorGrowable{};
+        frame.frameDescriptors.init(device, 1000, frameSizes);
 
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-        imageInfo.imageView = drawImage.imageView;
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        frame.uniforms.init(device, allocator, FRAME_UNIFORM_SIZE, properties.limits.minUniformBufferOffsetAlignment);
 
-        VkWriteDescriptorSet drawImageInfo{};
-        drawImageInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        drawImageInfo.pNext = nullptr;
+        gpuProfiler.createPool(frame);
+    }
 
-        drawImageInfo.dstBinding = 0;
-        drawImageInfo.dstSet = drawImageDescriptors;
-        drawImageInfo.descriptorCount = 1;
-        drawImageInfo.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-        drawImageInfo.pImageInfo = &imageInfo;
+    // The frame must be idle
+    void destroyFrameResources(FrameData& frame){
+        frame.deletionQueue.flush();
 
-        vkUpdateDescriptorSets(device, 1, &drawImageInfo, 0, nullptr);
-        
-        descriptorDeletionQueue.pushFunction([&](){
-            globalDescriptorAllocator.destroyPool(device);
-            vkDestroyDescriptorSetLayout(device, drawImageDescriptorLayout, nullptr);
-        });
+        gpuProfiler.destroyPool(frame);
+        frame.frameDescriptors.destroyPools(device);
+        frame.uniforms.destroy(allocator);
+
+        vkDestroyCommandPool(device, frame.commandPool, nullptr);
 
+        vkDestroyFence(device, frame.renderFence, nullptr);
+        vkDestroySemaphore(device, frame.renderSemaphore, nullptr);
+        vkDestroySemaphore(device, frame.swapchainSemaphore, nullptr);
     }
 
-    // copied, I assume from teh demo as well
-    void setupImgui(){
+    // Frames in flight and present mode picked in the UI take effect here, between frames
+    void applyFrameSettings(){
+        uint32_t overlap = std::clamp(options.frameOverlap, 1u, MAX_FRAME_OVERLAP);
+        bool overlapChanged = overlap != frameOverlap;
+        bool presentModeChanged = !options.headless && options.presentMode != presentMode;
+
+        if(!overlapChanged && !presentModeChanged){
+            return;
+        }
+
+        vkDeviceWaitIdle(device);
+
+        if(overlapChanged){
+            for (size_t i = 0; i < frameOverlap; i++)
+            {
+                destroyFrameResources(frames[i]);
+            }
+
+            frameOverlap = overlap;
+            for (size_t i = 0; i < frameOverlap; i++)
+            {
+                createFrameResources(frames[i]);
+            }
+
+            // the GPU is idle, so every frame recorded so far has finished with its staging
+            frameStaging.ring.retire(frameNumber);
+
+            fmt::println("Frames in flight: {}", frameOverlap);
+        }
+
+        if(presentModeChanged){
+            resizeSwapchain();
+        }
+    }
+
+    void setupSyncStructures(){
+        VkFenceCreateInfo fenceCreateInfo = Initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+
+        VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &immediateFence));
+        mainDeletionQueue.pushFunction([=](){
+            vkDestroyFence(device, immediateFence, nullptr);
+        });
+    }
+
+    void setupUploadQueue(){
+        uploadQueue.init(device, allocator, transferQueue, transferQueueFamily);
+        frameStaging.init(allocator, FRAME_STAGING_SIZE);
+
+        mainDeletionQueue.pushFunction([&](){
+            uploadQueue.destroy();
+            frameStaging.destroy(allocator);
+        });
+    }
+
+    // Copies data into dst at the start of the next recorded frame, for small data that changes every frame.
+    // The staging comes from a ring recycled with the FrameData fences, so there are no allocations or extra submits.
+    bool uploadThisFrame(VkBuffer dst, VkDeviceSize dstOffset, const void* data, size_t size){
+        std::optional<StagingAllocation> allocation = frameStaging.allocate(size);
+        if(!allocation.has_value()){
+            fmt::println("Frame staging ring is full, dropped a {} byte upload", size);
+            return false;
+        }
+
+        memcpy(allocation->data, data, size);
+
+        VkBufferCopy copy{};
+        copy.srcOffset = allocation->offset;
+        copy.dstOffset = dstOffset;
+        copy.size = size;
+        frameCopies.push_back({dst, copy});
+
+        return true;
+    }
+
+    void recordFrameCopies(VkCommandBuffer command){
+        if(frameCopies.empty()){
+            return;
+        }
+
+        Utility::recordBufferCopies(command, frameStaging.buffer.buffer, frameCopies, getCurrentFrame().arena);
+        frameCopies.clear();
+
+        Utility::memoryBarrier(command, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT);
+    }
+
+    void drawBackground(VkCommandBuffer command){
+        ComputeEffect& effect = backgroundEffects[currentBackgroundEffect];
+
+        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
+
+        effect.data.imageIndex = drawImageStorageIndex;
+
+        vkCmdPushConstants(command, gradientPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &effect.data);
+        vkCmdDispatch(command, std::ceil(drawExtent.width/16.0), std::ceil(drawExtent.height/16.0), 1);
+    }
+
+    void setupBindless(){
+        bindless.init(device, physicalDevice);
+
+        mainDeletionQueue.pushFunction([&](){
+            bindless.destroy();
+        });
+    }
+
+    // The nearest sampler outlives the render targets, they're recreated when the window outgrows them
+    void setupRenderTargets(){
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &nearestSampler));
+
+        createRenderTargets(swapchainExtent);
+
+        mainDeletionQueue.pushFunction([&](){
+            destroyRenderTargets(currentRenderTargets());
+            vkDestroySampler(device, nearestSampler, nullptr);
+        });
+    }
+
+    // Draw, depth and depth pyramid images with their bindless slots
+    void createRenderTargets(VkExtent2D extent){
+        VkExtent3D drawImageExtent = {
+            extent.width,
+            extent.height,
+            1
+        };
+
+        drawImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+        drawImage.imageExtent = drawImageExtent;
+
+        VkImageUsageFlags drawImageUsage{};
+        drawImageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        drawImageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        drawImageUsage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        drawImageUsage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+        VkImageCreateInfo rimageInfo = Initializers::imageCreateInfo(drawImage.imageFormat, drawImageUsage, drawImageExtent);
+
+        VmaAllocationCreateInfo rimageAllocInfo{};
+        rimageAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        rimageAllocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VK_CHECK(vmaCreateImage(allocator, &rimageInfo, &rimageAllocInfo, &drawImage.image, &drawImage.allocation, nullptr));
+
+        VkImageViewCreateInfo rviewInfo = Initializers::imageViewCreateInfo(drawImage.imageFormat, drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        VK_CHECK(vkCreateImageView(device, &rviewInfo, nullptr, &drawImage.imageView));
+
+        depthImage.imageFormat = VK_FORMAT_D32_SFLOAT;
+        depthImage.imageExtent = drawImageExtent;
+
+        VkImageUsageFlags depthImageUsages{};
+        depthImageUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        depthImageUsages |= VK_IMAGE_USAGE_SAMPLED_BIT;
+
+        VkImageCreateInfo dImageInfo = Initializers::imageCreateInfo(depthImage.imageFormat, depthImageUsages, drawImageExtent);
+
+        VK_CHECK(vmaCreateImage(allocator, &dImageInfo, &rimageAllocInfo, &depthImage.image, &depthImage.allocation, nullptr));
+
+        VkImageViewCreateInfo dviewInfo = Initializers::imageViewCreateInfo(depthImage.imageFormat, depthImage.image, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+        VK_CHECK(vkCreateImageView(device, &dviewInfo, nullptr, &depthImage.imageView));
+
+        drawImageStorageIndex = bindless.addStorageImage(drawImage.imageView);
+        depthImageIndex = bindless.addSampledImage(depthImage.imageView, nearestSampler, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+
+        // level 0 is half the depth image, every level keeps the max of the texels it covers
+        depthPyramidExtent.width = std::max(1u, depthImage.imageExtent.width / 2);
+        depthPyramidExtent.height = std::max(1u, depthImage.imageExtent.height / 2);
+        depthPyramidLevels = Utility::mipLevels(depthPyramidExtent);
+
+        depthPyramid.imageFormat = VK_FORMAT_R32_SFLOAT;
+        depthPyramid.imageExtent = {depthPyramidExtent.width, depthPyramidExtent.height, 1};
+
+        VkImageCreateInfo imageInfo = Initializers::imageCreateInfo(depthPyramid.imageFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, depthPyramid.imageExtent, depthPyramidLevels);
+
+        VK_CHECK(vmaCreateImage(allocator, &imageInfo, &rimageAllocInfo, &depthPyramid.image, &depthPyramid.allocation, nullptr));
+
+        VkImageViewCreateInfo viewInfo = Initializers::imageViewCreateInfo(depthPyramid.imageFormat, depthPyramid.image, VK_IMAGE_ASPECT_COLOR_BIT);
+        viewInfo.subresourceRange.levelCount = depthPyramidLevels;
+
+        VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &depthPyramid.imageView));
+
+        // the pyramid stays in GENERAL, it's written as storage and read through a sampler
+        depthPyramidIndex = bindless.addSampledImage(depthPyramid.imageView, nearestSampler, VK_IMAGE_LAYOUT_GENERAL);
+
+        depthPyramidMips.resize(depthPyramidLevels);
+        depthPyramidMipIndices.resize(depthPyramidLevels);
+        for (uint32_t i = 0; i < depthPyramidLevels; i++)
+        {
+            VkImageViewCreateInfo mipInfo = Initializers::imageViewCreateInfo(depthPyramid.imageFormat, depthPyramid.image, VK_IMAGE_ASPECT_COLOR_BIT);
+            mipInfo.subresourceRange.baseMipLevel = i;
+
+            VK_CHECK(vkCreateImageView(device, &mipInfo, nullptr, &depthPyramidMips[i]));
+            depthPyramidMipIndices[i] = bindless.addStorageImage(depthPyramidMips[i]);
+        }
+
+        // moved to GENERAL by the first buildDepthPyramid
+        depthPyramidReady = false;
+    }
+
+    RenderTargets currentRenderTargets(){
+        RenderTargets targets;
+        targets.drawImage = drawImage;
+        targets.depthImage = depthImage;
+        targets.depthPyramid = depthPyramid;
+        targets.depthPyramidMips = depthPyramidMips;
+
+        targets.storageIndices = depthPyramidMipIndices;
+        targets.storageIndices.push_back(drawImageStorageIndex);
+        targets.sampledIndices = {depthImageIndex, depthPyramidIndex};
+        return targets;
+    }
+
+    void destroyRenderTargets(const RenderTargets& targets){
+        for(auto index: targets.storageIndices){
+            bindless.removeStorageImage(index);
+        }
+        for(auto index: targets.sampledIndices){
+            bindless.removeSampledImage(index);
+        }
+
+        for(auto view: targets.depthPyramidMips){
+            vkDestroyImageView(device, view, nullptr);
+        }
+        vkDestroyImageView(device, targets.depthPyramid.imageView, nullptr);
+        vmaDestroyImage(allocator, targets.depthPyramid.image, targets.depthPyramid.allocation);
+
+        vkDestroyImageView(device, targets.drawImage.imageView, nullptr);
+        vmaDestroyImage(allocator, targets.drawImage.image, targets.drawImage.allocation);
+
+        vkDestroyImageView(device, targets.depthImage.imageView, nullptr);
+        vmaDestroyImage(allocator, targets.depthImage.image, targets.depthImage.allocation);
+    }
+
+    // Tests every object against the frustum and last frame's depth pyramid and compacts the survivors
+    // into sceneBuffers.drawBuffer, with one draw count per batch
+    void cullScene(VkCommandBuffer command){
+        if(sceneBuffers.objectCount == 0 || sceneDataAddress == 0){
+            return;
+        }
+
+        // last frame's indirect reads and pyramid writes are done before the buffers are reused
+        Utility::memoryBarrier(command, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+        vkCmdFillBuffer(command, sceneBuffers.countBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+
+        Utility::memoryBarrier(command, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+
+        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        bindless.bind(command, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout);
+
+        CullPushConstants pushConstants;
+        pushConstants.sceneData = sceneDataAddress;
+        pushConstants.objectBuffer = sceneBuffers.objectBufferAddress;
+        pushConstants.commandBuffer = sceneBuffers.indirectBufferAddress;
+        pushConstants.drawBuffer = sceneBuffers.drawBufferAddress;
+        pushConstants.countBuffer = sceneBuffers.countBufferAddress;
+        pushConstants.pyramidSize = glm::vec2(depthPyramidExtent.width, depthPyramidExtent.height);
+        pushConstants.objectCount = sceneBuffers.objectCount;
+        pushConstants.pyramidIndex = depthPyramidIndex;
+        pushConstants.pyramidLevels = depthPyramidLevels;
+
+        // the pyramid holds nothing until one frame has been drawn
+        pushConstants.cullFlags = 0;
+        if(frustumCulling) pushConstants.cullFlags |= CULL_FRUSTUM;
+        if(occlusionCulling && depthPyramidReady) pushConstants.cullFlags |= CULL_OCCLUSION;
+
+        vkCmdPushConstants(command, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &pushConstants);
+        vkCmdDispatch(command, (sceneBuffers.objectCount + 63) / 64, 1, 1);
+
+        Utility::memoryBarrier(command, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+    }
+
+    // Reduces this frame's depth into the pyramid the next frame culls against
+    void buildDepthPyramid(VkCommandBuffer command){
+        Utility::transitionImage(command, depthImage.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+
+        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipeline);
+        bindless.bind(command, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipelineLayout);
+
+        // fresh pyramids start out UNDEFINED, every level is overwritten below
+        if(!depthPyramidReady){
+            Utility::transitionImage(command, depthPyramid.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        // the pyramid always covers the rendered part of the depth image, same as the viewport culling projects into
+        glm::uvec2 srcSize = {drawExtent.width, drawExtent.height};
+        for (uint32_t i = 0; i < depthPyramidLevels; i++)
+        {
+            glm::uvec2 dstSize = {std::max(1u, depthPyramidExtent.width >> i), std::max(1u, depthPyramidExtent.height >> i)};
+
+            DepthReducePushConstants pushConstants;
+            pushConstants.srcSize = srcSize;
+            pushConstants.dstSize = dstSize;
+            pushConstants.srcIndex = (i == 0) ? depthImageIndex : depthPyramidMipIndices[i - 1];
+            pushConstants.dstIndex = depthPyramidMipIndices[i];
+            pushConstants.fromDepth = (i == 0) ? 1 : 0;
+
+            vkCmdPushConstants(command, depthReducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthReducePushConstants), &pushConstants);
+            vkCmdDispatch(command, (dstSize.x + 15) / 16, (dstSize.y + 15) / 16, 1);
+
+            Utility::memoryBarrier(command, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+
+            srcSize = dstSize;
+        }
+
+        depthPyramidReady = true;
+    }
+
+    void setupDescriptors(){
+        std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1}
+        };
+
+        globalDescriptorAllocator.init(device, 10, sizes);
+
+        descriptorDeletionQueue.pushFunction([&](){
+            globalDescriptorAllocator.destroyPools(device);
+        });
+
+    }
+
+    // copied, I assume from teh demo as well
+    void setupImgui(){
         VkDescriptorPoolSize pool_sizes[] = { { VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000 },
 		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000 },
@@ -601,17 +1396,93 @@ private:
         vkCmdEndRendering(command);
     }
 
+    void setupPipelineCache(){
+        pipelineCache.init(device, physicalDevice, PIPELINE_CACHE_PATH);
+
+        mainDeletionQueue.pushFunction([&](){
+            pipelineCache.save();
+            pipelineCache.destroy();
+        });
+    }
+
+    // The known pipelines don't depend on each other, so they're compiled in parallel on the worker pool.
+    // The setup functions only create their own objects, destruction is registered here once they're all done.
     void setupPipeline(){
-        setupBackgroundPipeline();
-        // setupTrianglePipeline();
-        setupMeshPipeline();
+        pipelineRegistry.init(device, pipelineCache.cache);
+        shaderCache.init(device);
+
+        std::vector<std::function<void()>> builds = {
+            [&](){ setupBackgroundPipeline(); },
+            // [&](){ setupTrianglePipeline(); },
+            [&](){ setupMeshPipeline(); },
+            [&](){ setupCullPipelines(); }
+        };
+
+        workerPool.parallelFor(builds.size(), [&](size_t i){
+            builds[i]();
+        });
+
+        // a destroyed module's handle can come back for another shader, so lookups by handle end here
+        pipelineRegistry.forgetShaders();
+        shaderCache.clear();
+
+        bool missing = meshPipeline == VK_NULL_HANDLE || cullPipeline == VK_NULL_HANDLE || depthReducePipeline == VK_NULL_HANDLE;
+        for(auto& effect: backgroundEffects){
+            missing = missing || effect.pipeline == VK_NULL_HANDLE;
+        }
+        if(missing){
+            throw std::runtime_error("Failed to build pipelines, see the shaders reported above");
+        }
+
+        mainDeletionQueue.pushFunction([&](){
+            pipelineRegistry.destroy();
+
+            vkDestroyPipelineLayout(device, gradientPipelineLayout, nullptr);
+            vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr);
+            vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+            vkDestroyPipelineLayout(device, depthReducePipelineLayout, nullptr);
+        });
+    }
+
+    // Shader module that stays alive until setupPipeline is done with it
+    VkShaderModule loadSetupShader(const char* shaderPath){
+        return shaderCache.get(shaderPath);
+    }
+
+    VkPipelineLayout createComputePipelineLayout(uint32_t pushConstantSize){
+        VkPushConstantRange pushConstant{};
+        pushConstant.offset = 0;
+        pushConstant.size = pushConstantSize;
+        pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkPipelineLayoutCreateInfo layoutInfo = Initializers::pipelineLayoutCreateInfo();
+        layoutInfo.pSetLayouts = &bindless.layout;
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pPushConstantRanges = &pushConstant;
+        layoutInfo.pushConstantRangeCount = 1;
+
+        VkPipelineLayout layout;
+        VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &layout));
+        return layout;
+    }
+
+    VkPipeline createComputePipeline(const char* shaderPath, VkPipelineLayout layout){
+        return pipelineRegistry.getComputePipeline(loadSetupShader(shaderPath), layout);
+    }
+
+    void setupCullPipelines(){
+        cullPipelineLayout = createComputePipelineLayout(sizeof(CullPushConstants));
+        cullPipeline = createComputePipeline("shaders\\cull.comp.spv", cullPipelineLayout);
+
+        depthReducePipelineLayout = createComputePipelineLayout(sizeof(DepthReducePushConstants));
+        depthReducePipeline = createComputePipeline("shaders\\depth_reduce.comp.spv", depthReducePipelineLayout);
     }
 
     void setupBackgroundPipeline(){
         VkPipelineLayoutCreateInfo computeLayout{};
         computeLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         computeLayout.pNext = nullptr;
-        computeLayout.pSetLayouts = &drawImageDescriptorLayout;
+        computeLayout.pSetLayouts = &bindless.layout;
         computeLayout.setLayoutCount = 1;
 
         VkPushConstantRange pushConstant{};
@@ -624,29 +1495,8 @@ private:
 
         VK_CHECK(vkCreatePipelineLayout(device, &computeLayout, nullptr, &gradientPipelineLayout));
 
-        VkShaderModule gradientShader;
-        if(!Utility::loadShaderModule("shaders\\gradient.comp.spv", device, &gradientShader)){
-            fmt::print("Failed to load gradient Shader!");
-        }
-
-        VkShaderModule skyShader;
-        if(!Utility::loadShaderModule("shaders\\sky.comp.spv", device, &skyShader)){
-            fmt::print("Failed to load sky Shader!");
-        }
-
-        VkPipelineShaderStageCreateInfo stageInfo{};
-        stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        stageInfo.pNext = nullptr;
-
-        stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-        stageInfo.module = gradientShader;
-        stageInfo.pName = "main";
-
-        VkComputePipelineCreateInfo computePipelineCreateInfo{};
-        computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-        computePipelineCreateInfo.pNext = nullptr;
-        computePipelineCreateInfo.layout = gradientPipelineLayout;
-        computePipelineCreateInfo.stage = stageInfo;
+        VkShaderModule gradientShader = loadSetupShader("shaders\\gradient.comp.spv");
+        VkShaderModule skyShader = loadSetupShader("shaders\\sky.comp.spv");
 
         ComputeEffect gradient;
         gradient.layout = gradientPipelineLayout;
@@ -655,9 +1505,7 @@ private:
         gradient.data.data1 = glm::vec4(1, 1, 0, 1);
         gradient.data.data2 = glm::vec4(0, 0, 1, 1);
 
-        VK_CHECK(vkCreateComputePipelines(device,VK_NULL_HANDLE,1,&computePipelineCreateInfo, nullptr, &gradient.pipeline));
-
-        computePipelineCreateInfo.stage.module = skyShader;
+        gradient.pipeline = pipelineRegistry.getComputePipeline(gradientShader, gradientPipelineLayout);
 
         ComputeEffect sky;
         sky.layout = gradientPipelineLayout;
@@ -666,20 +1514,10 @@ private:
 
         sky.data.data1 = glm::vec4(0.1, 0.2, 0.4 ,0.97);
 
-        VK_CHECK(vkCreateComputePipelines(device,VK_NULL_HANDLE,1,&computePipelineCreateInfo, nullptr, &sky.pipeline));
+        sky.pipeline = pipelineRegistry.getComputePipeline(skyShader, gradientPipelineLayout);
 
         backgroundEffects.push_back(gradient);
         backgroundEffects.push_back(sky);
-
-        vkDestroyShaderModule(device, gradientShader, nullptr);
-        vkDestroyShaderModule(device, skyShader, nullptr);
-        mainDeletionQueue.pushFunction([&]() {
-            vkDestroyPipelineLayout(device, gradientPipelineLayout, nullptr);
-            for (size_t i = 0; i < backgroundEffects.size(); i++)
-            {
-                vkDestroyPipeline(device, backgroundEffects[i].pipeline, nullptr);
-            }            
-        });
     }
 
     void drawGeometry(VkCommandBuffer command){
@@ -712,31 +1550,32 @@ private:
 
         // vkCmdDraw(command, 3, 1, 0, 0);
 
-        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+        if(sceneBuffers.objectCount > 0 && sceneDataAddress != 0){
+            vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
 
-        GPUDrawPushConstants pushConstants;
-        pushConstants.worldMatrix = glm::mat4(1.f);
-        pushConstants.vertexBuffer = rectangle.vertexBufferAddress;
+            GPUScenePushConstants pushConstants;
+            pushConstants.sceneData = sceneDataAddress;
+            pushConstants.objectBuffer = sceneBuffers.objectBufferAddress;
 
-        vkCmdPushConstants(command, meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
-        vkCmdBindIndexBuffer(command, rectangle.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-        
-        // HARDCODED TO DRAW 6 VERTICES
-        vkCmdDrawIndexed(command, 6, 1, 0, 0, 0);
+            vkCmdPushConstants(command, meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUScenePushConstants), &pushConstants);
+
+            // one call per index buffer no matter how many objects there are, the counts come from cullScene
+            for (size_t i = 0; i < sceneBuffers.batches.size(); i++)
+            {
+                const IndirectBatch& batch = sceneBuffers.batches[i];
+
+                vkCmdBindIndexBuffer(command, batch.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+                vkCmdDrawIndexedIndirectCount(command, sceneBuffers.drawBuffer.buffer, batch.firstCommand * sizeof(VkDrawIndexedIndirectCommand),
+                    sceneBuffers.countBuffer.buffer, i * sizeof(uint32_t), batch.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+            }
+        }
 
         vkCmdEndRendering(command);
     }
 
     void setupTrianglePipeline(){
-        VkShaderModule triangleVertShader;
-        if(!Utility::loadShaderModule("shaders\\shader.vert.spv", device, &triangleVertShader)){
-            fmt::println("Failed to load vertex shader");
-        }
-
-        VkShaderModule triangleFragShader;
-        if(!Utility::loadShaderModule("shaders\\shader.frag.spv", device, &triangleFragShader)){
-            fmt::println("Failed to load frag shader");
-        }
+        VkShaderModule triangleVertShader = loadSetupShader("shaders\\shader.vert.spv");
+        VkShaderModule triangleFragShader = loadSetupShader("shaders\\shader.frag.spv");
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo = Initializers::pipelineLayoutCreateInfo();
 
@@ -756,36 +1595,27 @@ private:
         pipelineBuilder.setColorAttachmentFormat(drawImage.imageFormat);
         pipelineBuilder.setDepthFormat(VK_FORMAT_UNDEFINED);
 
-        trianglePipeline = pipelineBuilder.buildPipeline(device);
-
-        vkDestroyShaderModule(device, triangleFragShader, nullptr);
-        vkDestroyShaderModule(device, triangleVertShader, nullptr);
+        trianglePipeline = pipelineRegistry.getPipeline(pipelineBuilder);
 
         mainDeletionQueue.pushFunction([&](){
             vkDestroyPipelineLayout(device, trianglePipelineLayout, nullptr);
-            vkDestroyPipeline(device, trianglePipeline, nullptr);
         });
     }
 
     void setupMeshPipeline(){
-        VkShaderModule triangleVertShader;
-        if(!Utility::loadShaderModule("shaders\\shader.vert.spv", device, &triangleVertShader)){
-            fmt::println("Failed to load vertex shader");
-        }
-
-        VkShaderModule triangleFragShader;
-        if(!Utility::loadShaderModule("shaders\\shader.frag.spv", device, &triangleFragShader)){
-            fmt::println("Failed to load frag shader");
-        }
+        VkShaderModule triangleVertShader = loadSetupShader("shaders\\shader.vert.spv");
+        VkShaderModule triangleFragShader = loadSetupShader("shaders\\shader.frag.spv");
 
         VkPushConstantRange bufferRange{};
         bufferRange.offset = 0;
-        bufferRange.size = sizeof(GPUDrawPushConstants);
+        bufferRange.size = sizeof(GPUScenePushConstants);
         bufferRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
         VkPipelineLayoutCreateInfo layoutInfo = Initializers::pipelineLayoutCreateInfo();
         layoutInfo.pPushConstantRanges = &bufferRange;
         layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pSetLayouts = &bindless.layout;
+        layoutInfo.setLayoutCount = 1;
 
         VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &meshPipelineLayout));
 
@@ -803,19 +1633,14 @@ private:
         pipelineBuilder.setColorAttachmentFormat(drawImage.imageFormat);
         pipelineBuilder.setDepthFormat(depthImage.imageFormat);
 
-        meshPipeline = pipelineBuilder.buildPipeline(device);
-
-        vkDestroyShaderModule(device, triangleFragShader, nullptr);
-        vkDestroyShaderModule(device, triangleVertShader, nullptr);
-
-        mainDeletionQueue.pushFunction([&](){
-            vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr);
-            vkDestroyPipeline(device, meshPipeline, nullptr);
-        });
+        meshPipeline = pipelineRegistry.getPipeline(pipelineBuilder);
     }
 
     GPUMeshBuffers uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices){
-        const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
+        glm::vec4 vertexQuantization = VertexFormat::quantization(vertices);
+        std::vector<GPUVertex> encoded = VertexFormat::encode(vertices, vertexQuantization);
+
+        const size_t vertexBufferSize = encoded.size() * sizeof(GPUVertex);
         const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
 
         GPUMeshBuffers newSurface;
@@ -827,36 +1652,164 @@ private:
         deviceAddressInfo.buffer = newSurface.vertexBuffer.buffer;
         
         newSurface.vertexBufferAddress = vkGetBufferDeviceAddress(device, &deviceAddressInfo);
+        newSurface.vertexQuantization = vertexQuantization;
 
         newSurface.indexBuffer = createBuffer(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
 
-        AllocatedBuffer staging = createBuffer(vertexBufferSize + indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        uploadQueue.uploadBuffer(newSurface.vertexBuffer.buffer, 0, encoded.data(), vertexBufferSize);
+        newSurface.upload = uploadQueue.uploadBuffer(newSurface.indexBuffer.buffer, 0, indices.data(), indexBufferSize);
+
+        return newSurface;
+    }
+
+    // Uploads every mesh into one shared vertex/index buffer pair, the copies are batched by the upload queue
+    std::vector<std::shared_ptr<Loader::MeshAsset>> uploadMeshes(std::span<Loader::MeshData> meshes){
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        for(auto& mesh: meshes){
+            vertexCount += mesh.vertices.size();
+            indexCount += mesh.indices.size();
+        }
+
+        if(vertexCount == 0 || indexCount == 0){
+            return {};
+        }
 
-        void* data = staging.allocation->GetMappedData();
+        GPUMeshBuffers shared = createSharedMeshBuffers(vertexCount, indexCount);
 
-        memcpy(data, vertices.data(), vertexBufferSize);
+        std::vector<std::shared_ptr<Loader::MeshAsset>> assets;
+        assets.reserve(meshes.size());
 
-        memcpy((char*)data+vertexBufferSize, indices.data(), indexBufferSize);
+        size_t vertexBase = 0;
+        size_t indexBase = 0;
+        for(auto& mesh: meshes){
+            auto asset = std::make_shared<Loader::MeshAsset>();
+            asset->name = mesh.name;
+            asset->meshBuffers = shared;
+            asset->meshBuffers.vertexBufferAddress = shared.vertexBufferAddress + vertexBase * sizeof(GPUVertex);
+            asset->meshBuffers.vertexQuantization = mesh.vertexQuantization;
 
-        immediateSubmit([&](VkCommandBuffer command) {
-            VkBufferCopy vertexCopy{0};
-            vertexCopy.dstOffset = 0;
-            vertexCopy.srcOffset = 0;
-            vertexCopy.size = vertexBufferSize;
+            for(auto surface: mesh.surfaces){
+                surface.startIndex += static_cast<uint32_t>(indexBase);
+                asset->surfaces.push_back(surface);
+            }
 
-            vkCmdCopyBuffer(command, staging.buffer, newSurface.vertexBuffer.buffer, 1, &vertexCopy);
+            std::vector<GPUVertex> vertices = VertexFormat::encode(mesh.vertices, mesh.vertexQuantization);
+            uploadQueue.uploadBuffer(shared.vertexBuffer.buffer, vertexBase * sizeof(GPUVertex), vertices.data(), vertices.size() * sizeof(GPUVertex));
+            shared.upload = uploadQueue.uploadBuffer(shared.indexBuffer.buffer, indexBase * sizeof(uint32_t), mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
 
-            VkBufferCopy indexCopy{0};
-            indexCopy.dstOffset = 0;
-            indexCopy.srcOffset = vertexBufferSize;
-            indexCopy.size = indexBufferSize;
+            vertexBase += mesh.vertices.size();
+            indexBase += mesh.indices.size();
 
-            vkCmdCopyBuffer(command, staging.buffer, newSurface.indexBuffer.buffer, 1, &indexCopy);
-        });
+            assets.push_back(asset);
+        }
 
-        destroyBuffer(staging);
+        // the batch is only usable once its last copy has landed
+        for(auto& asset: assets){
+            asset->meshBuffers.upload = shared.upload;
+        }
 
-        return newSurface;
+        return assets;
+    }
+
+    // Vertex and index buffers for a batch of meshes uploaded together
+    GPUMeshBuffers createSharedMeshBuffers(size_t vertexCount, size_t indexCount){
+        GPUMeshBuffers shared;
+        shared.vertexBuffer = createBuffer(vertexCount * sizeof(GPUVertex), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        shared.indexBuffer = createBuffer(indexCount * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+        VkBufferDeviceAddressInfo deviceAddressInfo{};
+        deviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        deviceAddressInfo.buffer = shared.vertexBuffer.buffer;
+
+        shared.vertexBufferAddress = vkGetBufferDeviceAddress(device, &deviceAddressInfo);
+        return shared;
+    }
+
+    // Same result as uploadMeshes, but the whole vertex and index sections go straight from the mapped file into staging
+    std::vector<std::shared_ptr<Loader::MeshAsset>> uploadCachedMeshes(const MeshCache::CachedMeshes& cache){
+        std::span<const GPUVertex> vertices = cache.vertices();
+        std::span<const uint32_t> indices = cache.indices();
+        if(vertices.empty() || indices.empty()){
+            return {};
+        }
+
+        GPUMeshBuffers shared = createSharedMeshBuffers(vertices.size(), indices.size());
+
+        uploadQueue.uploadBuffer(shared.vertexBuffer.buffer, 0, vertices.data(), vertices.size_bytes());
+        shared.upload = uploadQueue.uploadBuffer(shared.indexBuffer.buffer, 0, indices.data(), indices.size_bytes());
+
+        std::span<const MeshCache::SurfaceEntry> surfaces = cache.surfaces();
+
+        std::vector<std::shared_ptr<Loader::MeshAsset>> assets;
+        assets.reserve(cache.meshes().size());
+
+        for(auto& mesh: cache.meshes()){
+            auto asset = std::make_shared<Loader::MeshAsset>();
+            asset->name = cache.name(mesh);
+            asset->meshBuffers = shared;
+            asset->meshBuffers.vertexBufferAddress = shared.vertexBufferAddress + mesh.firstVertex * sizeof(GPUVertex);
+            asset->meshBuffers.vertexQuantization = mesh.vertexQuantization;
+
+            for(auto& entry: surfaces.subspan(mesh.firstSurface, mesh.surfaceCount)){
+                Loader::GeoSurface surface;
+                surface.startIndex = entry.startIndex + static_cast<uint32_t>(mesh.firstIndex);
+                surface.count = entry.count;
+                surface.bounds = entry.bounds;
+                surface.firstMeshlet = entry.firstMeshlet;
+                surface.meshletCount = entry.meshletCount;
+                asset->surfaces.push_back(surface);
+            }
+
+            assets.push_back(asset);
+        }
+
+        return assets;
+    }
+
+    // Loads from the binary cache next to the file while the files it was built from are unchanged, otherwise parses the glTF
+    // and writes a new cache for the next launch
+    std::optional<std::vector<std::shared_ptr<Loader::MeshAsset>>> loadGltfMeshes(const std::filesystem::path& filePath){
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        std::filesystem::path cachePath = MeshCache::cachePath(filePath);
+        std::vector<std::shared_ptr<Loader::MeshAsset>> assets;
+
+        MeshCache::CachedMeshes cache;
+        bool cached = cache.open(cachePath, filePath);
+        if(cached){
+            assets = uploadCachedMeshes(cache);
+        } else {
+            std::optional<std::vector<MeshCache::Dependency>> dependencies = MeshCache::collectDependencies(filePath);
+            if(!dependencies.has_value()){
+                fmt::println("Failed to open glTF file: {}", filePath.string());
+                return std::nullopt;
+            }
+
+            std::optional<std::vector<Loader::MeshData>> meshes = Loader::loadGltfMeshes(filePath, workerPool);
+            if(!meshes.has_value()){
+                return std::nullopt;
+            }
+
+            if(!MeshCache::write(cachePath, dependencies.value(), meshes.value())){
+                fmt::println("Failed to write mesh cache {}", cachePath.string());
+            }
+
+            assets = uploadMeshes(meshes.value());
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+        fmt::println("Loaded {} meshes from {} in {:.1f} ms", assets.size(), cached ? cachePath.string() : filePath.string(), elapsed.count());
+
+        if(!assets.empty()){
+            GPUMeshBuffers shared = assets[0]->meshBuffers;
+            mainDeletionQueue.pushFunction([=, this](){
+                destroyBuffer(shared.indexBuffer);
+                destroyBuffer(shared.vertexBuffer);
+            });
+        }
+
+        return assets;
     }
 
     AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage){
@@ -866,6 +1819,14 @@ private:
         bufferInfo.size = allocSize;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+        // written on the transfer queue and read on the graphics queue without ownership transfers
+        uint32_t queueFamilies[] = {graphicsQueueFamily, transferQueueFamily};
+        if(transferQueueFamily != graphicsQueueFamily){
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = 2;
+            bufferInfo.pQueueFamilyIndices = queueFamilies;
+        }
+
         bufferInfo.usage = usage;
 
         VmaAllocationCreateInfo vmaAllocInfo{};
@@ -878,6 +1839,14 @@ private:
         return newBuffer;
     }
 
+    VkDeviceAddress getBufferAddress(const AllocatedBuffer& buffer){
+        VkBufferDeviceAddressInfo deviceAddressInfo{};
+        deviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        deviceAddressInfo.buffer = buffer.buffer;
+
+        return vkGetBufferDeviceAddress(device, &deviceAddressInfo);
+    }
+
     void destroyBuffer(const AllocatedBuffer& buffer){
         vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
     }
@@ -890,6 +1859,10 @@ private:
         rect_vertices[2].position = {-0.5,-0.5, 0};
         rect_vertices[3].position = {-0.5,0.5, 0};
 
+        for(auto& vertex: rect_vertices){
+            vertex.normal = {0, 0, 1};
+        }
+
         rect_vertices[0].color = {0,0, 0,1};
         rect_vertices[1].color = { 0.5,0.5,0.5 ,1};
         rect_vertices[2].color = { 1,0, 0,1 };
@@ -907,6 +1880,8 @@ private:
 
         rectangle = uploadMesh(rect_indices,rect_vertices);
 
+        addRenderObject({6, 0, rectangle.indexBuffer.buffer, rectangle.vertexBufferAddress, rectangle.vertexQuantization, glm::mat4(1.f), Scene::computeBounds(rect_vertices), rectangle.upload});
+
         //delete the rectangle data on engine shutdown
         mainDeletionQueue.pushFunction([&](){
             destroyBuffer(rectangle.indexBuffer);
@@ -914,6 +1889,302 @@ private:
         });
     }
 
+    void setupDefaultMeshes(){
+        if(!std::filesystem::exists(DEFAULT_SCENE_PATH)){
+            return;
+        }
+
+        auto meshes = loadGltfMeshes(DEFAULT_SCENE_PATH);
+        if(meshes.has_value()){
+            testMeshes = meshes.value();
+        }
+
+        for(auto& mesh: testMeshes){
+            for(auto& surface: mesh->surfaces){
+                addRenderObject({surface.count, surface.startIndex, mesh->meshBuffers.indexBuffer.buffer, mesh->meshBuffers.vertexBufferAddress, mesh->meshBuffers.vertexQuantization, glm::mat4(1.f), surface.bounds, mesh->meshBuffers.upload});
+            }
+        }
+    }
+
+    void setupDefaultTextures(){
+        samplerCache.init(device);
+
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, TEXTURE_FORMAT, &formatProperties);
+        VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        canBlitMips = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+
+        mainDeletionQueue.pushFunction([&](){
+            samplerCache.destroy();
+        });
+
+        if(!std::filesystem::is_directory(DEFAULT_TEXTURE_DIRECTORY)){
+            return;
+        }
+
+        // a cooked .ctex next to a source image is used instead of decoding it
+        std::vector<std::filesystem::path> paths;
+        for(auto& entry: std::filesystem::directory_iterator(DEFAULT_TEXTURE_DIRECTORY)){
+            std::string extension = entry.path().extension().string();
+            if(extension == ".png" || extension == ".jpg" || extension == ".jpeg"){
+                paths.push_back(entry.path());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+
+        std::vector<std::filesystem::path> sourcePaths;
+        size_t cookedCount = 0;
+        for(auto& path: paths){
+            std::filesystem::path cookedPath = std::filesystem::path(path).replace_extension(".ctex");
+            if(std::filesystem::exists(cookedPath) && loadCookedTexture(cookedPath) != nullptr){
+                cookedCount++;
+            } else {
+                sourcePaths.push_back(path);
+            }
+        }
+
+        if(cookedCount > 0){
+            fmt::println("Mapped {} cooked textures", cookedCount);
+        }
+        if(!sourcePaths.empty()){
+            loadTextures(sourcePaths);
+        }
+    }
+
+    // Every level is copied straight from the mapped file into staging, nothing is decoded or blitted.
+    // Returns null when the file is invalid or its format can't be sampled here
+    std::shared_ptr<Texture> loadCookedTexture(const std::filesystem::path& path){
+        TextureFile::CookedTexture cooked;
+        if(!cooked.open(path)){
+            fmt::println("{} isn't a valid cooked texture", path.string());
+            return nullptr;
+        }
+
+        const TextureFile::Header& header = cooked.info();
+        VkFormat format = static_cast<VkFormat>(header.vkFormat);
+        if(header.blockSize > 1 && !compressedTextures){
+            return nullptr;
+        }
+
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+        if((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == 0){
+            return nullptr;
+        }
+
+        // level 0 has the widest rows, the others fit if it does
+        if(!uploadQueue.canUploadImage({header.width, header.height}, header.blockSize, header.bytesPerBlock)){
+            fmt::println("{} is too wide for the staging ring", path.string());
+            return nullptr;
+        }
+
+        auto texture = createTextureImage(path.stem().string(), format, {header.width, header.height}, header.mipLevels);
+        texture->generateMips = false;
+
+        for (uint32_t i = 0; i < header.mipLevels; i++)
+        {
+            const TextureFile::Level& level = cooked.level(i);
+            texture->upload = uploadQueue.uploadImageLevel(texture->image.image, i, {level.width, level.height}, cooked.levelData(i),
+                header.blockSize, header.bytesPerBlock, i == 0).value();
+        }
+
+        return texture;
+    }
+
+    // Decodes on the worker pool and queues each upload as its image comes in. The textures become usable a few frames later,
+    // once finishTextures() has seen their upload land
+    std::vector<std::shared_ptr<Texture>> loadTextures(std::span<const std::filesystem::path> paths){
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        // each image is uploaded as soon as it's decoded and freed right after, so only a few are held at once
+        std::vector<std::shared_ptr<Texture>> loaded;
+        Textures::decodeImages(paths, workerPool, [&](ImageData& image){
+            std::shared_ptr<Texture> texture = createTexture(image);
+            if(texture != nullptr){
+                loaded.push_back(texture);
+            }
+        });
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+        fmt::println("Loaded {} of {} textures in {:.1f} ms", loaded.size(), paths.size(), elapsed.count());
+
+        return loaded;
+    }
+
+    // Null when the image is too wide to go through the staging ring
+    std::shared_ptr<Texture> createTexture(const ImageData& data){
+        VkExtent2D extent = {data.width, data.height};
+        if(!uploadQueue.canUploadImage(extent, 1, 4)){
+            fmt::println("{} is too wide for the staging ring", data.name);
+            return nullptr;
+        }
+
+        auto texture = createTextureImage(data.name, TEXTURE_FORMAT, extent, canBlitMips ? Utility::mipLevels(extent) : 1);
+        texture->upload = uploadQueue.uploadImage(texture->image.image, extent, data.pixels.data(), 4).value();
+        return texture;
+    }
+
+    // Image, view and sampler of a texture that still needs its upload, tracked until finishTextures() sees it land
+    std::shared_ptr<Texture> createTextureImage(const std::string& name, VkFormat format, VkExtent2D extent, uint32_t mipLevels){
+        auto texture = std::make_shared<Texture>();
+        texture->name = name;
+        texture->mipLevels = mipLevels;
+        texture->image.imageFormat = format;
+        texture->image.imageExtent = {extent.width, extent.height, 1};
+
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        VkImageCreateInfo imageInfo = Initializers::imageCreateInfo(texture->image.imageFormat, usage, texture->image.imageExtent, texture->mipLevels);
+
+        // written on the transfer queue and read on the graphics queue without ownership transfers
+        uint32_t queueFamilies[] = {graphicsQueueFamily, transferQueueFamily};
+        if(transferQueueFamily != graphicsQueueFamily){
+            imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            imageInfo.queueFamilyIndexCount = 2;
+            imageInfo.pQueueFamilyIndices = queueFamilies;
+        }
+
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VK_CHECK(vmaCreateImage(allocator, &imageInfo, &allocInfo, &texture->image.image, &texture->image.allocation, nullptr));
+
+        VkImageViewCreateInfo viewInfo = Initializers::imageViewCreateInfo(texture->image.imageFormat, texture->image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+        viewInfo.subresourceRange.levelCount = texture->mipLevels;
+
+        VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &texture->image.imageView));
+
+        texture->sampler = samplerCache.getSampler(SamplerCache::linearRepeat());
+
+        mainDeletionQueue.pushImageView(texture->image.imageView);
+        mainDeletionQueue.pushImage(texture->image.image, texture->image.allocation);
+
+        textures.push_back(texture);
+        pendingTextures.push_back(texture);
+        return texture;
+    }
+
+    // Builds the mip chains of textures whose upload has landed and gives them a bindless slot.
+    // The frame's submit waits on the upload timeline, so the copied level 0 is visible to the blits
+    void finishTextures(VkCommandBuffer command){
+        std::erase_if(pendingTextures, [&](const std::shared_ptr<Texture>& texture){
+            if(!uploadQueue.isComplete(texture->upload)){
+                return false;
+            }
+
+            if(texture->generateMips){
+                VkExtent2D extent = {texture->image.imageExtent.width, texture->image.imageExtent.height};
+                Utility::generateMipmaps(command, texture->image.image, extent, texture->mipLevels);
+            } else {
+                Utility::mipBarrier(command, texture->image.image, 0, texture->mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+            }
+
+            texture->bindlessIndex = bindless.addSampledImage(texture->image.imageView, texture->sampler);
+            texture->ready = true;
+            return true;
+        });
+    }
+
+    // Writes this frame's camera and lighting into its uniform ring, every pass reads it through sceneDataAddress
+    void updateSceneData(){
+        float aspect = static_cast<float>(drawExtent.width) / static_cast<float>(std::max(drawExtent.height, 1u));
+
+        sceneData.view = camera.viewMatrix();
+        sceneData.proj = camera.projectionMatrix(aspect);
+        sceneData.viewProj = sceneData.proj * sceneData.view;
+        sceneData.prevViewProj = hasPrevViewProj ? prevViewProj : sceneData.viewProj;
+        sceneData.cameraPosition = glm::vec4(camera.position, 1.f);
+        sceneData.ambientColor = glm::vec4(0.3f);
+        sceneData.sunDirection = glm::vec4(glm::normalize(glm::vec3(-0.3f, -1.f, -0.5f)), 0.7f);
+        sceneData.sunColor = glm::vec4(1.f);
+
+        sceneDataAddress = getCurrentFrame().uniforms.push(sceneData);
+
+        prevViewProj = sceneData.viewProj;
+        hasPrevViewProj = true;
+    }
+
+    void addRenderObject(const RenderObject& object){
+        renderObjects.push_back(object);
+        sceneDirty = true;
+    }
+
+    // Keeps the GPU copy of renderObjects up to date. A rebuild is uploaded into fresh buffers while the
+    // old ones keep drawing, then swapped in once it has landed.
+    void updateScene(){
+        if(scenePending && uploadQueue.isComplete(pendingSceneBuffers.upload)){
+            retireSceneBuffers(sceneBuffers, getCurrentFrame().deletionQueue);
+
+            sceneBuffers = pendingSceneBuffers;
+            pendingSceneBuffers = SceneBuffers{};
+            scenePending = false;
+        }
+
+        if(!sceneDirty || scenePending){
+            return;
+        }
+
+        // hold the rebuild until every mesh it points at is on the GPU
+        for(auto& object: renderObjects){
+            if(!uploadQueue.isComplete(object.upload)){
+                return;
+            }
+        }
+
+        // only needed until the upload below has copied them into staging
+        LinearArena& arena = getCurrentFrame().arena;
+        ArenaVector<GPUObjectData> objectData{ArenaAllocator<GPUObjectData>(arena)};
+        ArenaVector<VkDrawIndexedIndirectCommand> commands{ArenaAllocator<VkDrawIndexedIndirectCommand>(arena)};
+
+        SceneBuffers next;
+        Scene::buildDrawData(renderObjects, objectData, commands, next.batches);
+        next.objectCount = static_cast<uint32_t>(renderObjects.size());
+
+        if(next.objectCount > 0){
+            const VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+            next.objectBuffer = createBuffer(objectData.size() * sizeof(GPUObjectData), storage, VMA_MEMORY_USAGE_GPU_ONLY);
+            next.indirectBuffer = createBuffer(commands.size() * sizeof(VkDrawIndexedIndirectCommand), storage, VMA_MEMORY_USAGE_GPU_ONLY);
+            next.drawBuffer = createBuffer(commands.size() * sizeof(VkDrawIndexedIndirectCommand), storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+            next.countBuffer = createBuffer(next.batches.size() * sizeof(uint32_t), storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+            next.objectBufferAddress = getBufferAddress(next.objectBuffer);
+            next.indirectBufferAddress = getBufferAddress(next.indirectBuffer);
+            next.drawBufferAddress = getBufferAddress(next.drawBuffer);
+            next.countBufferAddress = getBufferAddress(next.countBuffer);
+
+            uploadQueue.uploadBuffer(next.objectBuffer.buffer, 0, objectData.data(), objectData.size() * sizeof(GPUObjectData));
+            next.upload = uploadQueue.uploadBuffer(next.indirectBuffer.buffer, 0, commands.data(), commands.size() * sizeof(VkDrawIndexedIndirectCommand));
+        }
+
+        pendingSceneBuffers = next;
+        scenePending = true;
+        sceneDirty = false;
+    }
+
+    void destroySceneBuffers(const SceneBuffers& buffers){
+        if(buffers.objectCount == 0){
+            return;
+        }
+
+        destroyBuffer(buffers.objectBuffer);
+        destroyBuffer(buffers.indirectBuffer);
+        destroyBuffer(buffers.drawBuffer);
+        destroyBuffer(buffers.countBuffer);
+    }
+
+    void retireSceneBuffers(const SceneBuffers& buffers, DeletionQueue& queue){
+        if(buffers.objectCount == 0){
+            return;
+        }
+
+        queue.pushBuffer(buffers.objectBuffer.buffer, buffers.objectBuffer.allocation);
+        queue.pushBuffer(buffers.indirectBuffer.buffer, buffers.indirectBuffer.allocation);
+        queue.pushBuffer(buffers.drawBuffer.buffer, buffers.drawBuffer.allocation);
+        queue.pushBuffer(buffers.countBuffer.buffer, buffers.countBuffer.allocation);
+    }
+
     void cleanupWindow(){
         glfwDestroyWindow(window);
 
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "utils.h"
+
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <filesystem>
+
+// Frame times bucketed into a fixed histogram, so percentiles cost nothing to record and memory never grows.
+// Buckets are BUCKET_WIDTH ms wide up to MAX_TIME, anything slower lands in the last bucket (the max is exact).
+// Counters are atomics, recording from any thread is lock free; reading while recording gives a near-enough snapshot.
+class FrameHistogram {
+public:
+    static constexpr double BUCKET_WIDTH = 0.05;
+    static constexpr double MAX_TIME = 250.0;
+    static constexpr size_t BUCKET_COUNT = static_cast<size_t>(MAX_TIME / BUCKET_WIDTH) + 1;
+    static constexpr size_t RECENT_COUNT = 256;
+
+    struct Summary {
+        uint64_t frames = 0;
+        uint64_t overBudget = 0;
+        double budget = 0.0;
+        double average = 0.0;
+        double p50 = 0.0;
+        double p90 = 0.0;
+        double p99 = 0.0;
+        double p999 = 0.0;
+        double max = 0.0;
+    };
+
+    explicit FrameHistogram(double budget = FRAME_BUDGET_MS): budget(budget) {}
+
+    void record(double milliseconds){
+        size_t bucket = std::min(static_cast<size_t>(std::max(milliseconds, 0.0) / BUCKET_WIDTH), BUCKET_COUNT - 1);
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        frames.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t micro = static_cast<uint64_t>(milliseconds * 1000.0);
+        totalMicro.fetch_add(micro, std::memory_order_relaxed);
+
+        uint64_t currentMax = maxMicro.load(std::memory_order_relaxed);
+        while(micro > currentMax && !maxMicro.compare_exchange_weak(currentMax, micro, std::memory_order_relaxed)){}
+
+        if(milliseconds > budget){
+            overBudget.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        size_t slot = recentNext.fetch_add(1, std::memory_order_relaxed) % RECENT_COUNT;
+        recent[slot].store(static_cast<float>(milliseconds), std::memory_order_relaxed);
+    }
+
+    // Upper edge of the bucket holding the given fraction of frames, so a percentile never reads low
+    double percentile(double fraction) const {
+        uint64_t total = frames.load(std::memory_order_relaxed);
+        if(total == 0){
+            return 0.0;
+        }
+
+        uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * total)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; i++)
+        {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if(seen >= target){
+                return std::min((i + 1) * BUCKET_WIDTH, maxTime());
+            }
+        }
+        return maxTime();
+    }
+
+    Summary summary() const {
+        Summary result;
+        result.frames = frames.load(std::memory_order_relaxed);
+        result.overBudget = overBudget.load(std::memory_order_relaxed);
+        result.budget = budget;
+        result.average = result.frames > 0 ? totalMicro.load(std::memory_order_relaxed) / 1000.0 / result.frames : 0.0;
+        result.p50 = percentile(0.5);
+        result.p90 = percentile(0.9);
+        result.p99 = percentile(0.99);
+        result.p999 = percentile(0.999);
+        result.max = maxTime();
+        return result;
+    }
+
+    // Last RECENT_COUNT frame times oldest first, for plotting
+    std::array<float, RECENT_COUNT> recentFrames() const {
+        std::array<float, RECENT_COUNT> result;
+        size_t next = recentNext.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < RECENT_COUNT; i++)
+        {
+            result[i] = recent[(next + i) % RECENT_COUNT].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    // Picks the format from the extension, .json or anything else as .csv
+    bool write(const std::filesystem::path& path) const {
+        std::ofstream file(path, std::ios::trunc);
+        if(!file.is_open()){
+            fmt::println("Failed to write frame stats {}", path.string());
+            return false;
+        }
+
+        Summary s = summary();
+
+        if(path.extension() == ".json"){
+            file << fmt::format("{{\n  \"frames\": {},\n  \"budgetMs\": {:.3f},\n  \"overBudget\": {},\n", s.frames, s.budget, s.overBudget);
+            file << fmt::format("  \"averageMs\": {:.3f},\n  \"p50Ms\": {:.3f},\n  \"p90Ms\": {:.3f},\n  \"p99Ms\": {:.3f},\n  \"p999Ms\": {:.3f},\n  \"maxMs\": {:.3f},\n",
+                s.average, s.p50, s.p90, s.p99, s.p999, s.max);
+            file << fmt::format("  \"bucketWidthMs\": {},\n  \"buckets\": [", BUCKET_WIDTH);
+
+            // only buckets that saw a frame, as [lower edge in ms, count]
+            bool first = true;
+            for (size_t i = 0; i < BUCKET_COUNT; i++)
+            {
+                uint64_t count = buckets[i].load(std::memory_order_relaxed);
+                if(count == 0){
+                    continue;
+                }
+                file << fmt::format("{}[{:.2f}, {}]", first ? "" : ", ", i * BUCKET_WIDTH, count);
+                first = false;
+            }
+            file << "]\n}\n";
+        } else {
+            file << "metric,value\n";
+            file << fmt::format("frames,{}\nbudget_ms,{:.3f}\nover_budget,{}\n", s.frames, s.budget, s.overBudget);
+            file << fmt::format("average_ms,{:.3f}\np50_ms,{:.3f}\np90_ms,{:.3f}\np99_ms,{:.3f}\np999_ms,{:.3f}\nmax_ms,{:.3f}\n",
+                s.average, s.p50, s.p90, s.p99, s.p999, s.max);
+
+            file << "\nbucket_ms,count\n";
+            for (size_t i = 0; i < BUCKET_COUNT; i++)
+            {
+                uint64_t count = buckets[i].load(std::memory_order_relaxed);
+                if(count > 0){
+                    file << fmt::format("{:.2f},{}\n", i * BUCKET_WIDTH, count);
+                }
+            }
+        }
+
+        fmt::println("Wrote frame stats to {}", path.string());
+        return true;
+    }
+
+private:
+    double budget;
+
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> overBudget{0};
+    std::atomic<uint64_t> totalMicro{0};
+    std::atomic<uint64_t> maxMicro{0};
+
+    std::array<std::atomic<float>, RECENT_COUNT> recent{};
+    std::atomic<size_t> recentNext{0};
+
+    double maxTime() const {
+        return maxMicro.load(std::memory_order_relaxed) / 1000.0;
+    }
+};
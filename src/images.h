@@ -3,13 +3,16 @@
 #include "utils.h"
 #include "initializers.h"
 
+#include <fstream>
+#include <filesystem>
+
 namespace Utility{
     void transitionImage(VkCommandBuffer command, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout) {
         VkImageMemoryBarrier2 imageBarrier{};
         imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
         imageBarrier.pNext = nullptr;
 
-        imageBarrier.srcStageMask - VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
         imageBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
         imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
         imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
@@ -17,7 +20,8 @@ namespace Utility{
         imageBarrier.oldLayout = currentLayout;
         imageBarrier.newLayout = newLayout;
 
-        VkImageAspectFlags aspectMask = (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        bool isDepth = newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL || newLayout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL || currentLayout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+        VkImageAspectFlags aspectMask = isDepth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
         imageBarrier.subresourceRange = Initializers::imageSubresourceRange(aspectMask);
         imageBarrier.image = image;
 
@@ -31,6 +35,26 @@ namespace Utility{
         vkCmdPipelineBarrier2(command, &depInfo);
     }
 
+    void memoryBarrier(VkCommandBuffer command, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess){
+        VkMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = srcStage;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstStageMask = dstStage;
+        barrier.dstAccessMask = dstAccess;
+
+        VkDependencyInfo depInfo{};
+        depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        depInfo.memoryBarrierCount = 1;
+        depInfo.pMemoryBarriers = &barrier;
+
+        vkCmdPipelineBarrier2(command, &depInfo);
+    }
+
+    uint32_t mipLevels(VkExtent2D extent){
+        return static_cast<uint32_t>(std::floor(std::log2(std::max(extent.width, extent.height)))) + 1;
+    }
+
     void copyImageToImage(VkCommandBuffer command, VkImage src, VkImage dst, VkExtent2D srcSize, VkExtent2D dstSize){
         VkImageBlit2 blitRegion{};
         blitRegion.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2;
@@ -70,4 +94,103 @@ namespace Utility{
         
         vkCmdBlitImage2(command, &blitInfo);
     }
-};
\ No newline at end of file
+
+    void mipBarrier(VkCommandBuffer command, VkImage image, uint32_t level, uint32_t levelCount, VkImageLayout currentLayout, VkImageLayout newLayout,
+        VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess){
+        VkImageMemoryBarrier2 imageBarrier{};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        imageBarrier.srcStageMask = srcStage;
+        imageBarrier.srcAccessMask = srcAccess;
+        imageBarrier.dstStageMask = dstStage;
+        imageBarrier.dstAccessMask = dstAccess;
+        imageBarrier.oldLayout = currentLayout;
+        imageBarrier.newLayout = newLayout;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = image;
+        imageBarrier.subresourceRange = Initializers::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+        imageBarrier.subresourceRange.baseMipLevel = level;
+        imageBarrier.subresourceRange.levelCount = levelCount;
+
+        VkDependencyInfo depInfo{};
+        depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        depInfo.imageMemoryBarrierCount = 1;
+        depInfo.pImageMemoryBarriers = &imageBarrier;
+
+        vkCmdPipelineBarrier2(command, &depInfo);
+    }
+
+    // Fills levels 1..mipLevels-1 by blitting each level down from the one above it.
+    // Every level starts in TRANSFER_DST_OPTIMAL with level 0 written, all of them end in SHADER_READ_ONLY_OPTIMAL
+    void generateMipmaps(VkCommandBuffer command, VkImage image, VkExtent2D extent, uint32_t mipLevels){
+        for (uint32_t level = 1; level < mipLevels; level++)
+        {
+            // the level above was just written, by the upload or the previous blit
+            mipBarrier(command, image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+
+            VkExtent2D next = {std::max(1u, extent.width / 2), std::max(1u, extent.height / 2)};
+
+            VkImageBlit2 blitRegion{};
+            blitRegion.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2;
+
+            blitRegion.srcOffsets[1] = {static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1};
+            blitRegion.dstOffsets[1] = {static_cast<int32_t>(next.width), static_cast<int32_t>(next.height), 1};
+
+            blitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blitRegion.srcSubresource.mipLevel = level - 1;
+            blitRegion.srcSubresource.layerCount = 1;
+
+            blitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blitRegion.dstSubresource.mipLevel = level;
+            blitRegion.dstSubresource.layerCount = 1;
+
+            VkBlitImageInfo2 blitInfo{};
+            blitInfo.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2;
+            blitInfo.srcImage = image;
+            blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            blitInfo.dstImage = image;
+            blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            blitInfo.filter = VK_FILTER_LINEAR;
+            blitInfo.regionCount = 1;
+            blitInfo.pRegions = &blitRegion;
+
+            vkCmdBlitImage2(command, &blitInfo);
+
+            extent = next;
+        }
+
+        // every level but the last is a blit source by now
+        if(mipLevels > 1){
+            mipBarrier(command, image, 0, mipLevels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+        }
+        mipBarrier(command, image, mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+    }
+
+    // Binary PPM from tightly packed BGRA8 pixels, the layout of a B8G8R8A8 image copied to a buffer
+    bool writePPM(const std::filesystem::path& path, const uint8_t* bgra, uint32_t width, uint32_t height){
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if(!file.is_open()){
+            return false;
+        }
+
+        file << "P6\n" << width << " " << height << "\n255\n";
+
+        std::vector<uint8_t> row(width * 3);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint8_t* src = bgra + static_cast<size_t>(y) * width * 4;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                row[x * 3 + 0] = src[x * 4 + 2];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 0];
+            }
+            file.write(reinterpret_cast<const char*>(row.data()), row.size());
+        }
+
+        return file.good();
+    }
+};
@@ -52,7 +52,7 @@ namespace Initializers{
         return info;
     }
 
-    VkImageCreateInfo imageCreateInfo(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent){
+    VkImageCreateInfo imageCreateInfo(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent, uint32_t mipLevels = 1){
         VkImageCreateInfo info{};
         info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         info.pNext = nullptr;
@@ -63,7 +63,7 @@ namespace Initializers{
         info.extent = extent;
         info.extent.depth = 1;
 
-        info.mipLevels = 1;
+        info.mipLevels = mipLevels;
         info.arrayLayers = 1;
 
         info.samples = VK_SAMPLE_COUNT_1_BIT;   // For MSAA
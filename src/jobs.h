@@ -0,0 +1,137 @@
+#pragma once
+
+#include "utils.h"
+#include "trace.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+namespace Jobs{
+    // Fixed set of worker threads used for load-time work (parsing, decoding, etc)
+    class WorkerPool {
+    public:
+        void start(uint32_t threadCount = 0){
+            if(threadCount == 0){
+                threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+            }
+
+            stopping = false;
+            for (uint32_t i = 0; i < threadCount; i++)
+            {
+                workers.emplace_back([this, i](){
+                    Trace::setThreadName(fmt::format("Worker {}", i));
+                    workerLoop();
+                });
+            }
+        }
+
+        void stop(){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            condition.notify_all();
+
+            for(auto& worker: workers){
+                worker.join();
+            }
+            workers.clear();
+        }
+
+        uint32_t threadCount() const {
+            return static_cast<uint32_t>(workers.size());
+        }
+
+        void submit(std::function<void()> task){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push_back(std::move(task));
+            }
+            condition.notify_one();
+        }
+
+        // Calls function(i) for every i in [0, count) and returns once all of them are done.
+        // The calling thread takes part too, so this is safe to call from inside a task.
+        void parallelFor(size_t count, const std::function<void(size_t)>& function){
+            if(count == 0){
+                return;
+            }
+
+            if(workers.empty() || count == 1){
+                for (size_t i = 0; i < count; i++)
+                {
+                    function(i);
+                }
+                return;
+            }
+
+            struct Batch {
+                std::atomic<size_t> next{0};
+                std::atomic<size_t> done{0};
+                size_t count;
+                const std::function<void(size_t)>* function;
+                std::mutex mutex;
+                std::condition_variable finished;
+            };
+
+            auto batch = std::make_shared<Batch>();
+            batch->count = count;
+            batch->function = &function;
+
+            // helpers that start after every index is claimed just return, so the batch has to outlive this call
+            auto work = [batch](){
+                size_t completed = 0;
+                for(size_t i = batch->next++; i < batch->count; i = batch->next++){
+                    (*batch->function)(i);
+                    completed++;
+                }
+
+                if(completed > 0 && batch->done.fetch_add(completed) + completed == batch->count){
+                    std::lock_guard<std::mutex> lock(batch->mutex);
+                    batch->finished.notify_all();
+                }
+            };
+
+            size_t helpers = std::min(count - 1, workers.size());
+            for (size_t i = 0; i < helpers; i++)
+            {
+                submit(work);
+            }
+
+            work();
+
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            batch->finished.wait(lock, [&](){ return batch->done == batch->count; });
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+
+        void workerLoop(){
+            while(true){
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [this](){ return stopping || !tasks.empty(); });
+
+                    if(stopping && tasks.empty()){
+                        return;
+                    }
+
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+
+                Trace::Zone zone("Task");
+                task();
+            }
+        }
+    };
+};
@@ -0,0 +1,696 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+#include "scene.h"
+#include "jobs.h"
+#include "meshlets.h"
+#include "vertexformat.h"
+#include "meshprocessing.h"
+
+#include <fstream>
+#include <filesystem>
+#include <string_view>
+#include <cstring>
+#include <charconv>
+
+namespace Loader{
+    // Just enough JSON to read glTF documents
+    struct JsonValue {
+        enum class Type { Null, Bool, Number, String, Array, Object };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> values;  // array elements, or object members paired with keys
+        std::vector<std::string> keys;
+
+        const JsonValue* find(std::string_view key) const {
+            if(type != Type::Object){
+                return nullptr;
+            }
+
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                if(keys[i] == key){
+                    return &values[i];
+                }
+            }
+            return nullptr;
+        }
+
+        const JsonValue& operator[](std::string_view key) const {
+            const JsonValue* value = find(key);
+            return value ? *value : null();
+        }
+
+        const JsonValue& operator[](size_t index) const {
+            return (type == Type::Array && index < values.size()) ? values[index] : null();
+        }
+
+        bool has(std::string_view key) const {
+            return find(key) != nullptr;
+        }
+
+        size_t size() const {
+            return type == Type::Array ? values.size() : 0;
+        }
+
+        double asNumber(double fallback = 0.0) const {
+            return type == Type::Number ? number : fallback;
+        }
+
+        int64_t asInt(int64_t fallback = 0) const {
+            return type == Type::Number ? static_cast<int64_t>(number) : fallback;
+        }
+
+        bool asBool(bool fallback = false) const {
+            return type == Type::Bool ? boolean : fallback;
+        }
+
+        const std::string& asString() const {
+            return string;
+        }
+
+        static const JsonValue& null(){
+            static const JsonValue value;
+            return value;
+        }
+    };
+
+    class JsonParser {
+    public:
+        JsonParser(std::string_view text) : text(text) {}
+
+        std::optional<JsonValue> parse(){
+            JsonValue root;
+            if(!parseValue(root)){
+                return std::nullopt;
+            }
+            return root;
+        }
+
+    private:
+        std::string_view text;
+        size_t pos = 0;
+
+        void skipWhitespace(){
+            while(pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\r' || text[pos] == '\t')){
+                pos++;
+            }
+        }
+
+        bool consume(char c){
+            skipWhitespace();
+            if(pos < text.size() && text[pos] == c){
+                pos++;
+                return true;
+            }
+            return false;
+        }
+
+        bool parseValue(JsonValue& out){
+            skipWhitespace();
+            if(pos >= text.size()){
+                return false;
+            }
+
+            char c = text[pos];
+            if(c == '{'){
+                return parseObject(out);
+            }
+            if(c == '['){
+                return parseArray(out);
+            }
+            if(c == '"'){
+                out.type = JsonValue::Type::String;
+                return parseString(out.string);
+            }
+            if(text.compare(pos, 4, "true") == 0){
+                out.type = JsonValue::Type::Bool;
+                out.boolean = true;
+                pos += 4;
+                return true;
+            }
+            if(text.compare(pos, 5, "false") == 0){
+                out.type = JsonValue::Type::Bool;
+                out.boolean = false;
+                pos += 5;
+                return true;
+            }
+            if(text.compare(pos, 4, "null") == 0){
+                out.type = JsonValue::Type::Null;
+                pos += 4;
+                return true;
+            }
+            return parseNumber(out);
+        }
+
+        bool parseObject(JsonValue& out){
+            out.type = JsonValue::Type::Object;
+            pos++;
+
+            if(consume('}')){
+                return true;
+            }
+
+            do{
+                skipWhitespace();
+                std::string key;
+                if(!parseString(key) || !consume(':')){
+                    return false;
+                }
+
+                out.keys.push_back(std::move(key));
+                out.values.emplace_back();
+                if(!parseValue(out.values.back())){
+                    return false;
+                }
+            } while(consume(','));
+
+            return consume('}');
+        }
+
+        bool parseArray(JsonValue& out){
+            out.type = JsonValue::Type::Array;
+            pos++;
+
+            if(consume(']')){
+                return true;
+            }
+
+            do{
+                out.values.emplace_back();
+                if(!parseValue(out.values.back())){
+                    return false;
+                }
+            } while(consume(','));
+
+            return consume(']');
+        }
+
+        bool parseString(std::string& out){
+            if(pos >= text.size() || text[pos] != '"'){
+                return false;
+            }
+            pos++;
+
+            while(pos < text.size() && text[pos] != '"'){
+                char c = text[pos++];
+                if(c != '\\'){
+                    out.push_back(c);
+                    continue;
+                }
+
+                if(pos >= text.size()){
+                    return false;
+                }
+
+                char escaped = text[pos++];
+                switch(escaped){
+                    case 'n': out.push_back('\n'); break;
+                    case 't': out.push_back('\t'); break;
+                    case 'r': out.push_back('\r'); break;
+                    case 'b': out.push_back('\b'); break;
+                    case 'f': out.push_back('\f'); break;
+                    case 'u': {
+                        if(pos + 4 > text.size()){
+                            return false;
+                        }
+                        // exactly 4 hex digits, anything else is a malformed document rather than an exception
+                        uint32_t code = 0;
+                        const char* digits = text.data() + pos;
+                        std::from_chars_result parsed = std::from_chars(digits, digits + 4, code, 16);
+                        if(parsed.ec != std::errc() || parsed.ptr != digits + 4){
+                            return false;
+                        }
+                        pos += 4;
+
+                        // names and uris only, so surrogate pairs are not worth handling
+                        if(code < 0x80){
+                            out.push_back(static_cast<char>(code));
+                        } else if(code < 0x800){
+                            out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                        } else {
+                            out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                        }
+                        break;
+                    }
+                    default: out.push_back(escaped); break;
+                }
+            }
+
+            if(pos >= text.size()){
+                return false;
+            }
+            pos++;
+            return true;
+        }
+
+        bool parseNumber(JsonValue& out){
+            size_t start = pos;
+            while(pos < text.size() && (std::isdigit(static_cast<unsigned char>(text[pos])) || text[pos] == '-' || text[pos] == '+' || text[pos] == '.' || text[pos] == 'e' || text[pos] == 'E')){
+                pos++;
+            }
+
+            if(start == pos){
+                return false;
+            }
+
+            out.type = JsonValue::Type::Number;
+            out.number = std::strtod(std::string(text.substr(start, pos - start)).c_str(), nullptr);
+            return true;
+        }
+    };
+
+    struct GeoSurface {
+        uint32_t startIndex;
+        uint32_t count;
+        glm::vec4 bounds;   // bounding sphere of the surface's vertices
+        uint32_t firstMeshlet = 0;
+        uint32_t meshletCount = 0;
+    };
+
+    // CPU side mesh, indices are local to its own vertices
+    struct MeshData {
+        std::string name;
+        std::vector<GeoSurface> surfaces;
+        std::vector<Vertex> vertices;
+        glm::vec4 vertexQuantization;           // the vertices are encoded with it, see VertexFormat::quantization
+        std::vector<uint32_t> indices;
+        std::vector<Meshlet> meshlets;          // surface by surface, see GeoSurface::firstMeshlet
+        std::vector<uint32_t> meshletVertices;
+        std::vector<uint8_t> meshletTriangles;
+    };
+
+    // GPU side mesh, every mesh uploaded in the same batch shares one vertex and index buffer
+    struct MeshAsset {
+        std::string name;
+        std::vector<GeoSurface> surfaces;   // startIndex points into the shared index buffer
+        GPUMeshBuffers meshBuffers;         // vertexBufferAddress already points at this mesh's first vertex
+    };
+
+    struct GltfDocument {
+        JsonValue json;
+        std::vector<std::vector<uint8_t>> buffers;
+    };
+
+    std::vector<uint8_t> readBinaryFile(const std::filesystem::path& path){
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+        if(!file.is_open()){
+            return {};
+        }
+
+        size_t fileSize = (size_t) file.tellg();
+        std::vector<uint8_t> buffer(fileSize);
+
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
+
+        return buffer;
+    }
+
+    std::vector<uint8_t> decodeBase64(std::string_view encoded){
+        auto decodeChar = [](char c) -> int {
+            if(c >= 'A' && c <= 'Z') return c - 'A';
+            if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+            if(c >= '0' && c <= '9') return c - '0' + 52;
+            if(c == '+') return 62;
+            if(c == '/') return 63;
+            return -1;
+        };
+
+        std::vector<uint8_t> out;
+        out.reserve(encoded.size() * 3 / 4);
+
+        uint32_t accumulator = 0;
+        int bits = 0;
+        for(char c: encoded){
+            int value = decodeChar(c);
+            if(value < 0){
+                continue;
+            }
+
+            accumulator = (accumulator << 6) | value;
+            bits += 6;
+            if(bits >= 8){
+                bits -= 8;
+                out.push_back(static_cast<uint8_t>((accumulator >> bits) & 0xFF));
+            }
+        }
+        return out;
+    }
+
+    std::optional<GltfDocument> readGltfDocument(const std::filesystem::path& filePath){
+        std::vector<uint8_t> file = readBinaryFile(filePath);
+        if(file.empty()){
+            fmt::println("Failed to open glTF file: {}", filePath.string());
+            return std::nullopt;
+        }
+
+        GltfDocument document;
+        std::string_view jsonText;
+        std::vector<uint8_t> glbBinary;
+
+        const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+        const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+        const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+        uint32_t magic = 0;
+        if(file.size() >= 12){
+            memcpy(&magic, file.data(), sizeof(uint32_t));
+        }
+
+        if(magic == GLB_MAGIC){
+            size_t offset = 12;
+            while(offset + 8 <= file.size()){
+                uint32_t chunkLength, chunkType;
+                memcpy(&chunkLength, file.data() + offset, sizeof(uint32_t));
+                memcpy(&chunkType, file.data() + offset + 4, sizeof(uint32_t));
+                offset += 8;
+
+                if(offset + chunkLength > file.size()){
+                    fmt::println("Truncated GLB chunk in {}", filePath.string());
+                    return std::nullopt;
+                }
+
+                if(chunkType == GLB_CHUNK_JSON){
+                    jsonText = std::string_view(reinterpret_cast<const char*>(file.data() + offset), chunkLength);
+                } else if(chunkType == GLB_CHUNK_BIN){
+                    glbBinary.assign(file.data() + offset, file.data() + offset + chunkLength);
+                }
+
+                offset += chunkLength;
+            }
+        } else {
+            jsonText = std::string_view(reinterpret_cast<const char*>(file.data()), file.size());
+        }
+
+        std::optional<JsonValue> json = JsonParser(jsonText).parse();
+        if(!json.has_value()){
+            fmt::println("Failed to parse glTF json: {}", filePath.string());
+            return std::nullopt;
+        }
+        document.json = std::move(json.value());
+
+        const JsonValue& buffers = document.json["buffers"];
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            const JsonValue& buffer = buffers[i];
+
+            if(!buffer.has("uri")){
+                // buffer without uri refers to the GLB binary chunk
+                document.buffers.push_back(std::move(glbBinary));
+                continue;
+            }
+
+            const std::string& uri = buffer["uri"].asString();
+            if(uri.rfind("data:", 0) == 0){
+                size_t comma = uri.find(',');
+                document.buffers.push_back(decodeBase64(std::string_view(uri).substr(comma + 1)));
+            } else {
+                document.buffers.push_back(readBinaryFile(filePath.parent_path() / uri));
+            }
+
+            if(document.buffers.back().size() < static_cast<size_t>(buffer["byteLength"].asInt())){
+                fmt::println("glTF buffer {} is missing or truncated in {}", i, filePath.string());
+                return std::nullopt;
+            }
+        }
+
+        return document;
+    }
+
+    uint32_t componentCount(const std::string& type){
+        if(type == "SCALAR") return 1;
+        if(type == "VEC2") return 2;
+        if(type == "VEC3") return 3;
+        if(type == "VEC4") return 4;
+        if(type == "MAT4") return 16;
+        return 0;
+    }
+
+    uint32_t componentSize(int64_t componentType){
+        switch(componentType){
+            case 5120: case 5121: return 1;  // byte, unsigned byte
+            case 5122: case 5123: return 2;  // short, unsigned short
+            case 5125: case 5126: return 4;  // unsigned int, float
+            default: return 0;
+        }
+    }
+
+    float readComponent(const uint8_t* data, int64_t componentType, bool normalized){
+        switch(componentType){
+            case 5120: { int8_t v; memcpy(&v, data, 1); return normalized ? std::max(v / 127.f, -1.f) : v; }
+            case 5121: { uint8_t v = *data; return normalized ? v / 255.f : v; }
+            case 5122: { int16_t v; memcpy(&v, data, 2); return normalized ? std::max(v / 32767.f, -1.f) : v; }
+            case 5123: { uint16_t v; memcpy(&v, data, 2); return normalized ? v / 65535.f : v; }
+            case 5125: { uint32_t v; memcpy(&v, data, 4); return static_cast<float>(v); }
+            case 5126: { float v; memcpy(&v, data, 4); return v; }
+            default: return 0.f;
+        }
+    }
+
+    // Calls function(elementIndex, value) for every element of an accessor, missing components are left at 0
+    template<typename F>
+    bool readAccessor(const GltfDocument& document, int64_t accessorIndex, F&& function){
+        const JsonValue& accessor = document.json["accessors"][accessorIndex];
+        if(accessor.type != JsonValue::Type::Object){
+            return false;
+        }
+
+        size_t count = accessor["count"].asInt();
+        int64_t componentType = accessor["componentType"].asInt();
+        bool normalized = accessor["normalized"].asBool();
+        uint32_t components = componentCount(accessor["type"].asString());
+        uint32_t elementSize = components * componentSize(componentType);
+
+        if(!accessor.has("bufferView")){
+            // sparse-only or zero filled accessors
+            for (size_t i = 0; i < count; i++)
+            {
+                function(i, glm::vec4(0.f));
+            }
+            return true;
+        }
+
+        const JsonValue& view = document.json["bufferViews"][accessor["bufferView"].asInt()];
+        size_t bufferIndex = view["buffer"].asInt();
+        if(bufferIndex >= document.buffers.size() || elementSize == 0){
+            return false;
+        }
+
+        const std::vector<uint8_t>& buffer = document.buffers[bufferIndex];
+        size_t stride = view["byteStride"].asInt(elementSize);
+        size_t offset = view["byteOffset"].asInt() + accessor["byteOffset"].asInt();
+
+        if(count > 0 && offset + (count - 1) * stride + elementSize > buffer.size()){
+            return false;
+        }
+
+        uint32_t size = componentSize(componentType);
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint8_t* element = buffer.data() + offset + i * stride;
+
+            glm::vec4 value(0.f);
+            for (uint32_t c = 0; c < std::min(components, 4u); c++)
+            {
+                value[c] = readComponent(element + c * size, componentType, normalized);
+            }
+            function(i, value);
+        }
+        return true;
+    }
+
+    bool readIndices(const GltfDocument& document, int64_t accessorIndex, size_t vertexBase, std::vector<uint32_t>& indices){
+        const JsonValue& accessor = document.json["accessors"][accessorIndex];
+        const JsonValue& view = document.json["bufferViews"][accessor["bufferView"].asInt()];
+
+        size_t count = accessor["count"].asInt();
+        int64_t componentType = accessor["componentType"].asInt();
+        uint32_t size = componentSize(componentType);
+        size_t bufferIndex = view["buffer"].asInt();
+
+        if(bufferIndex >= document.buffers.size() || size == 0){
+            return false;
+        }
+
+        const std::vector<uint8_t>& buffer = document.buffers[bufferIndex];
+        size_t stride = view["byteStride"].asInt(size);
+        size_t offset = view["byteOffset"].asInt() + accessor["byteOffset"].asInt();
+
+        if(count > 0 && offset + (count - 1) * stride + size > buffer.size()){
+            return false;
+        }
+
+        indices.reserve(indices.size() + count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint8_t* element = buffer.data() + offset + i * stride;
+
+            uint32_t index = 0;
+            memcpy(&index, element, size);   // little endian, so the low bytes are enough
+            indices.push_back(static_cast<uint32_t>(index + vertexBase));
+        }
+        return true;
+    }
+
+    bool parseMesh(const GltfDocument& document, const JsonValue& mesh, MeshData& out){
+        const JsonValue& primitives = mesh["primitives"];
+
+        for (size_t p = 0; p < primitives.size(); p++)
+        {
+            const JsonValue& primitive = primitives[p];
+
+            if(primitive["mode"].asInt(4) != 4){
+                // only triangle lists end up in the index layout we draw with
+                continue;
+            }
+
+            const JsonValue& attributes = primitive["attributes"];
+            if(!attributes.has("POSITION")){
+                continue;
+            }
+
+            size_t vertexBase = out.vertices.size();
+            size_t vertexCount = document.json["accessors"][attributes["POSITION"].asInt()]["count"].asInt();
+
+            out.vertices.resize(vertexBase + vertexCount);
+            for (size_t i = vertexBase; i < out.vertices.size(); i++)
+            {
+                Vertex& v = out.vertices[i];
+                v.position = glm::vec3(0.f);
+                v.normal = {1, 0, 0};
+                v.color = glm::vec4(1.f);
+                v.uv_x = 0;
+                v.uv_y = 0;
+            }
+
+            Vertex* vertices = out.vertices.data() + vertexBase;
+            bool ok = readAccessor(document, attributes["POSITION"].asInt(), [&](size_t i, glm::vec4 value){
+                if(i < vertexCount) vertices[i].position = glm::vec3(value);
+            });
+
+            if(ok && attributes.has("NORMAL")){
+                ok = readAccessor(document, attributes["NORMAL"].asInt(), [&](size_t i, glm::vec4 value){
+                    if(i < vertexCount) vertices[i].normal = glm::vec3(value);
+                });
+            }
+
+            if(ok && attributes.has("TEXCOORD_0")){
+                ok = readAccessor(document, attributes["TEXCOORD_0"].asInt(), [&](size_t i, glm::vec4 value){
+                    if(i < vertexCount){
+                        vertices[i].uv_x = value.x;
+                        vertices[i].uv_y = value.y;
+                    }
+                });
+            }
+
+            if(ok && attributes.has("COLOR_0")){
+                bool hasAlpha = componentCount(document.json["accessors"][attributes["COLOR_0"].asInt()]["type"].asString()) == 4;
+                ok = readAccessor(document, attributes["COLOR_0"].asInt(), [&](size_t i, glm::vec4 value){
+                    if(i < vertexCount) vertices[i].color = hasAlpha ? value : glm::vec4(glm::vec3(value), 1.f);
+                });
+            }
+
+            if(!ok){
+                return false;
+            }
+
+            GeoSurface surface;
+            surface.startIndex = static_cast<uint32_t>(out.indices.size());
+
+            if(primitive.has("indices")){
+                if(!readIndices(document, primitive["indices"].asInt(), vertexBase, out.indices)){
+                    return false;
+                }
+            } else {
+                for (size_t i = 0; i < vertexCount; i++)
+                {
+                    out.indices.push_back(static_cast<uint32_t>(vertexBase + i));
+                }
+            }
+
+            for (size_t i = surface.startIndex; i < out.indices.size(); i++)
+            {
+                if(out.indices[i] >= out.vertices.size()){
+                    return false;
+                }
+            }
+
+            surface.count = static_cast<uint32_t>(out.indices.size()) - surface.startIndex;
+            surface.bounds = Scene::computeBounds(std::span<const Vertex>(vertices, vertexCount));
+            out.surfaces.push_back(surface);
+        }
+
+        return true;
+    }
+
+    // Reorders a parsed mesh for the GPU: shared vertices are merged, every surface's triangles are ordered for the
+    // post-transform cache and then for overdraw, and the vertices are renumbered in the order the triangles fetch them
+    void optimizeMesh(MeshData& mesh){
+        MeshProcessing::deduplicateVertices(mesh.vertices, mesh.indices);
+
+        std::vector<uint32_t> globalToLocal(mesh.vertices.size(), UINT32_MAX);
+        MeshProcessing::LocalSurface local;
+        for(auto& surface: mesh.surfaces){
+            std::span<uint32_t> indices = std::span<uint32_t>(mesh.indices).subspan(surface.startIndex, surface.count);
+            MeshProcessing::toLocal(indices, mesh.vertices, globalToLocal, local);
+            MeshProcessing::optimizeVertexCache(local.indices, local.vertices.size());
+            MeshProcessing::optimizeOverdraw(local.indices, local.vertices);
+            MeshProcessing::fromLocal(local, indices);
+        }
+
+        MeshProcessing::optimizeVertexFetch(mesh.vertices, mesh.indices);
+    }
+
+    // Splits every surface into meshlets that never cross a surface boundary
+    void buildMeshlets(MeshData& mesh){
+        std::vector<uint8_t> slots(mesh.vertices.size(), UINT8_MAX);
+        for(auto& surface: mesh.surfaces){
+            surface.firstMeshlet = static_cast<uint32_t>(mesh.meshlets.size());
+            Meshlets::build(mesh.vertices, std::span<const uint32_t>(mesh.indices).subspan(surface.startIndex, surface.count),
+                mesh.meshlets, mesh.meshletVertices, mesh.meshletTriangles, slots);
+            surface.meshletCount = static_cast<uint32_t>(mesh.meshlets.size()) - surface.firstMeshlet;
+        }
+    }
+
+    // Parses every mesh of a .gltf/.glb file, meshes are converted and optimized in parallel on the worker pool
+    std::optional<std::vector<MeshData>> loadGltfMeshes(const std::filesystem::path& filePath, Jobs::WorkerPool& workers){
+        std::optional<GltfDocument> document = readGltfDocument(filePath);
+        if(!document.has_value()){
+            return std::nullopt;
+        }
+
+        const JsonValue& meshes = document->json["meshes"];
+
+        std::vector<MeshData> result(meshes.size());
+        std::atomic<bool> failed{false};
+
+        workers.parallelFor(meshes.size(), [&](size_t i){
+            const JsonValue& mesh = meshes[i];
+            result[i].name = mesh.has("name") ? mesh["name"].asString() : fmt::format("mesh_{}", i);
+
+            if(!parseMesh(document.value(), mesh, result[i])){
+                failed = true;
+                return;
+            }
+            optimizeMesh(result[i]);
+            buildMeshlets(result[i]);
+            result[i].vertexQuantization = VertexFormat::quantization(result[i].vertices);
+        });
+
+        if(failed){
+            fmt::println("Malformed mesh data in {}", filePath.string());
+            return std::nullopt;
+        }
+
+        return result;
+    }
+};
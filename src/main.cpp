@@ -1,8 +1,91 @@
 #include "engine.h"
 
-int main()
+#include <string_view>
+
+void printUsage(){
+    fmt::println("Usage: VulkanEngine [--headless] [--frames N] [--dump DIR] [--dump-every N] [--frames-in-flight N] [--present-mode MODE] [--dynamic-resolution] [--stats FILE] [--budget MS] [--trace FILE]");
+    fmt::println("  --headless      render offscreen without a window (works with software drivers like lavapipe)");
+    fmt::println("  --frames N      exit after N frames (headless default {})", HEADLESS_FRAME_COUNT);
+    fmt::println("  --dump DIR      headless only, write frames to DIR as .ppm");
+    fmt::println("  --dump-every N  dump every Nth frame (default 1)");
+    fmt::println("  --frames-in-flight N  frames recorded ahead of the GPU, 1 to {} (default {})", MAX_FRAME_OVERLAP, DEFAULT_FRAME_OVERLAP);
+    fmt::println("  --present-mode MODE   fifo, mailbox, immediate or fifo_relaxed (default fifo)");
+    fmt::println("  --dynamic-resolution  lower the render resolution when the GPU goes over the frame budget");
+    fmt::println("  --stats FILE    write frame time percentiles and histogram to FILE on exit (.json or .csv)");
+    fmt::println("  --budget MS     frame time budget for the stats (default {:.2f})", FRAME_BUDGET_MS);
+    fmt::println("  --trace FILE    write CPU zones to FILE as a Chrome trace (chrome://tracing, ui.perfetto.dev)");
+}
+
+bool parsePresentMode(std::string_view name, VkPresentModeKHR& mode){
+    for(auto& presentMode: PRESENT_MODES){
+        if(name == presentMode.name){
+            mode = presentMode.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseOptions(int argc, char* argv[], EngineOptions& options){
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(arg == "--headless"){
+            options.headless = true;
+        } else if(arg == "--frames" && hasValue){
+            options.frameCount = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if(arg == "--dump" && hasValue){
+            options.dumpPath = argv[++i];
+        } else if(arg == "--dump-every" && hasValue){
+            options.dumpInterval = static_cast<uint32_t>(std::max(1ul, std::strtoul(argv[++i], nullptr, 10)));
+        } else if(arg == "--frames-in-flight" && hasValue){
+            options.frameOverlap = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            if(options.frameOverlap < 1 || options.frameOverlap > MAX_FRAME_OVERLAP){
+                fmt::println("--frames-in-flight must be between 1 and {}", MAX_FRAME_OVERLAP);
+                return false;
+            }
+        } else if(arg == "--present-mode" && hasValue){
+            if(!parsePresentMode(argv[++i], options.presentMode)){
+                fmt::println("Unknown present mode: {}", argv[i]);
+                return false;
+            }
+        } else if(arg == "--dynamic-resolution"){
+            options.dynamicResolution = true;
+        } else if(arg == "--stats" && hasValue){
+            options.statsPath = argv[++i];
+        } else if(arg == "--budget" && hasValue){
+            options.frameBudget = std::strtod(argv[++i], nullptr);
+        } else if(arg == "--trace" && hasValue){
+            options.tracePath = argv[++i];
+        } else {
+            fmt::println("Unknown argument: {}", arg);
+            return false;
+        }
+    }
+
+    if(options.headless && options.frameCount == 0){
+        options.frameCount = HEADLESS_FRAME_COUNT;
+    }
+
+    if(!options.headless && !options.dumpPath.empty()){
+        fmt::println("--dump only works with --headless");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
 {
-    Engine engine;
+    EngineOptions options;
+    if(!parseOptions(argc, argv, options)){
+        printUsage();
+        return 1;
+    }
+
+    Engine engine(options);
 
     engine.init();
 
@@ -10,4 +93,3 @@ int main()
 
     engine.cleanup();
 }
-
@@ -0,0 +1,118 @@
+#pragma once
+
+// Standard and OS headers only, the tools include this too
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+namespace Utility{
+    // Read-only view of a whole file mapped into memory, unmapped when it goes out of scope.
+    // The mapping is page aligned, so SPIR-V can be handed to Vulkan and file sections read in place straight from it.
+    class MappedFile {
+    public:
+        MappedFile() = default;
+
+        explicit MappedFile(const std::filesystem::path& path){
+            open(path);
+        }
+
+        ~MappedFile(){
+            close();
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::filesystem::path& path){
+            close();
+
+#ifdef _WIN32
+            HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if(file == INVALID_HANDLE_VALUE){
+                return false;
+            }
+
+            LARGE_INTEGER fileSize;
+            if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0){
+                CloseHandle(file);
+                return false;
+            }
+
+            // the view keeps the mapping alive, both handles can go right away
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if(mapping == nullptr){
+                return false;
+            }
+
+            void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if(view == nullptr){
+                return false;
+            }
+
+            mapped = static_cast<const uint8_t*>(view);
+            length = static_cast<size_t>(fileSize.QuadPart);
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0){
+                return false;
+            }
+
+            struct stat info;
+            if(fstat(fd, &info) != 0 || info.st_size <= 0){
+                ::close(fd);
+                return false;
+            }
+
+            // the mapping stays valid after the descriptor is closed
+            void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if(view == MAP_FAILED){
+                return false;
+            }
+
+            mapped = static_cast<const uint8_t*>(view);
+            length = static_cast<size_t>(info.st_size);
+#endif
+            return true;
+        }
+
+        void close(){
+            if(mapped == nullptr){
+                return;
+            }
+
+#ifdef _WIN32
+            UnmapViewOfFile(mapped);
+#else
+            munmap(const_cast<uint8_t*>(mapped), length);
+#endif
+            mapped = nullptr;
+            length = 0;
+        }
+
+        bool isOpen() const { return mapped != nullptr; }
+        const uint8_t* data() const { return mapped; }
+        size_t size() const { return length; }
+
+    private:
+        const uint8_t* mapped = nullptr;
+        size_t length = 0;
+    };
+};
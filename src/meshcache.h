@@ -0,0 +1,401 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+#include "loader.h"
+#include "meshlets.h"
+#include "vertexformat.h"
+#include "mappedfile.h"
+
+#include <fstream>
+#include <filesystem>
+#include <string_view>
+
+// Binary mesh cache (.cmesh) written the first time a glTF file is loaded, or ahead of time by MeshConverter.
+// A header, then sections that each start at a SECTION_ALIGNMENT offset: mesh entries, surfaces, meshlets,
+// dependencies, names, then every mesh's vertices already encoded as GPUVertex, indices, meshlet vertices and
+// meshlet triangles back to back. The vertex and index sections of a mapped cache are uploaded as they are with one copy each.
+// The dependencies are the source and the external buffers it references, keyed on their content hash. Each also keeps
+// its size and last write time, so a cache hit is usually checked with a few stat calls and never reads the glTF; a file
+// whose write time moved is hashed again. A cache only counts when every dependency, the version and the vertex format
+// match, otherwise the source is parsed again.
+namespace MeshCache{
+    const char MAGIC[8] = {'C', 'M', 'S', 'H', '\r', '\n', 0x1a, '\n'};
+    const uint32_t VERSION = 5;
+    const uint64_t SECTION_ALIGNMENT = 16;
+
+    struct Section {
+        uint64_t offset;    // from the start of the file
+        uint64_t size;      // in bytes
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertexSize;        // sizeof(GPUVertex) when written
+        uint32_t meshCount;
+        uint32_t vertexFormat;      // VERTEX_FORMAT when written
+        Section meshes;
+        Section surfaces;
+        Section meshlets;
+        Section dependencies;
+        Section names;
+        Section vertices;
+        Section indices;
+        Section meshletVertices;
+        Section meshletTriangles;
+    };
+
+    // Ranges are counts of elements into the sections, indices and surfaces are local to the mesh's own vertices
+    struct MeshEntry {
+        uint64_t firstVertex;
+        uint64_t vertexCount;
+        uint64_t firstIndex;
+        uint64_t indexCount;
+        uint64_t firstMeshletVertex;
+        uint64_t meshletVertexCount;
+        uint64_t firstMeshletTriangle;      // bytes, 3 per triangle
+        uint64_t meshletTriangleSize;
+        uint32_t firstSurface;
+        uint32_t surfaceCount;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        glm::vec4 vertexQuantization;
+    };
+
+    struct SurfaceEntry {
+        uint32_t startIndex;
+        uint32_t count;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        glm::vec4 bounds;
+    };
+
+    // A file the cache was built from, its path is in the names section and relative to the source's directory
+    struct DependencyEntry {
+        uint64_t size;
+        int64_t lastWrite;      // file clock ticks since its epoch
+        uint64_t hash;          // hashBytes of the whole file
+        uint32_t pathOffset;
+        uint32_t pathLength;
+    };
+
+    static_assert(sizeof(Header) == 168 && sizeof(MeshEntry) == 104 && sizeof(SurfaceEntry) == 32 && sizeof(Meshlet) == 32
+        && sizeof(DependencyEntry) == 32, "the file layout must not depend on the compiler");
+
+    struct Dependency {
+        std::string path;       // relative to the source's directory, with forward slashes
+        uint64_t size;
+        int64_t lastWrite;
+        uint64_t hash;
+    };
+
+    // Next to the source, scene.glb is cached as scene.glb.cmesh
+    std::filesystem::path cachePath(const std::filesystem::path& sourcePath){
+        std::filesystem::path path = sourcePath;
+        path += ".cmesh";
+        return path;
+    }
+
+    // FNV-1a, continued from hash
+    uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t hash = 14695981039346656037ull){
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool hashFile(const std::filesystem::path& path, uint64_t& hash){
+        hash = hashBytes(nullptr, 0);
+
+        Utility::MappedFile file;
+        if(!file.open(path)){
+            // an empty file can't be mapped but still has a hash
+            std::error_code error;
+            return std::filesystem::file_size(path, error) == 0 && !error;
+        }
+
+        hash = hashBytes(file.data(), file.size(), hash);
+        return true;
+    }
+
+    bool statFile(const std::filesystem::path& path, uint64_t& size, int64_t& lastWrite){
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if(error){
+            return false;
+        }
+
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+        if(error){
+            return false;
+        }
+        lastWrite = static_cast<int64_t>(time.time_since_epoch().count());
+        return true;
+    }
+
+    std::optional<Dependency> stampDependency(const std::filesystem::path& directory, const std::string& path){
+        Dependency dependency{path, 0, 0, 0};
+        std::filesystem::path fullPath = directory / path;
+        if(!statFile(fullPath, dependency.size, dependency.lastWrite) || !hashFile(fullPath, dependency.hash)){
+            return std::nullopt;
+        }
+        return dependency;
+    }
+
+    // The source and, for a .gltf, the external buffers it references, stamped now. Called before the source is parsed
+    // so an edit made while parsing makes the cache stale instead of being missed
+    std::optional<std::vector<Dependency>> collectDependencies(const std::filesystem::path& sourcePath){
+        std::filesystem::path directory = sourcePath.parent_path();
+
+        std::optional<Dependency> source = stampDependency(directory, sourcePath.filename().generic_string());
+        if(!source.has_value()){
+            return std::nullopt;
+        }
+
+        std::vector<Dependency> dependencies = {source.value()};
+
+        if(sourcePath.extension() == ".gltf"){
+            std::vector<uint8_t> text = Loader::readBinaryFile(sourcePath);
+            std::optional<Loader::JsonValue> json = Loader::JsonParser(std::string_view(reinterpret_cast<const char*>(text.data()), text.size())).parse();
+            if(json.has_value()){
+                const Loader::JsonValue& buffers = json.value()["buffers"];
+                for (size_t i = 0; i < buffers.size(); i++)
+                {
+                    const std::string& uri = buffers[i]["uri"].asString();
+                    if(uri.empty() || uri.rfind("data:", 0) == 0){
+                        continue;
+                    }
+
+                    std::optional<Dependency> buffer = stampDependency(directory, std::filesystem::path(uri).generic_string());
+                    if(buffer.has_value()){
+                        dependencies.push_back(buffer.value());
+                    }
+                }
+            }
+        }
+
+        return dependencies;
+    }
+
+    bool write(const std::filesystem::path& path, std::span<const Dependency> dependencies, std::span<const Loader::MeshData> meshes){
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if(!file.is_open()){
+            return false;
+        }
+
+        std::vector<MeshEntry> entries;
+        std::vector<SurfaceEntry> surfaces;
+        std::string names;
+
+        uint64_t vertexCount = 0, indexCount = 0, meshletCount = 0, meshletVertexCount = 0, meshletTriangleSize = 0;
+        for(auto& mesh: meshes){
+            MeshEntry entry{};
+            entry.firstVertex = vertexCount;
+            entry.vertexCount = mesh.vertices.size();
+            entry.firstIndex = indexCount;
+            entry.indexCount = mesh.indices.size();
+            entry.firstMeshletVertex = meshletVertexCount;
+            entry.meshletVertexCount = mesh.meshletVertices.size();
+            entry.firstMeshletTriangle = meshletTriangleSize;
+            entry.meshletTriangleSize = mesh.meshletTriangles.size();
+            entry.firstSurface = static_cast<uint32_t>(surfaces.size());
+            entry.surfaceCount = static_cast<uint32_t>(mesh.surfaces.size());
+            entry.firstMeshlet = static_cast<uint32_t>(meshletCount);
+            entry.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+            entry.nameOffset = static_cast<uint32_t>(names.size());
+            entry.nameLength = static_cast<uint32_t>(mesh.name.size());
+            entry.vertexQuantization = mesh.vertexQuantization;
+            entries.push_back(entry);
+
+            for(auto& surface: mesh.surfaces){
+                surfaces.push_back({surface.startIndex, surface.count, surface.firstMeshlet, surface.meshletCount, surface.bounds});
+            }
+            names += mesh.name;
+
+            vertexCount += mesh.vertices.size();
+            indexCount += mesh.indices.size();
+            meshletCount += mesh.meshlets.size();
+            meshletVertexCount += mesh.meshletVertices.size();
+            meshletTriangleSize += mesh.meshletTriangles.size();
+        }
+
+        std::vector<DependencyEntry> dependencyEntries;
+        for(auto& dependency: dependencies){
+            dependencyEntries.push_back({dependency.size, dependency.lastWrite, dependency.hash, static_cast<uint32_t>(names.size()), static_cast<uint32_t>(dependency.path.size())});
+            names += dependency.path;
+        }
+
+        Header header{};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.vertexSize = sizeof(GPUVertex);
+        header.vertexFormat = VERTEX_FORMAT;
+        header.meshCount = static_cast<uint32_t>(meshes.size());
+
+        // the header is written again at the end, once every section's offset is known
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+        const char padding[SECTION_ALIGNMENT] = {};
+        auto beginSection = [&](Section& section){
+            uint64_t offset = static_cast<uint64_t>(file.tellp());
+            uint64_t aligned = (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+            file.write(padding, aligned - offset);
+            section.offset = aligned;
+        };
+        auto writeSection = [&](Section& section, const void* data, size_t size){
+            beginSection(section);
+            file.write(static_cast<const char*>(data), size);
+            section.size = size;
+        };
+        // one section from the same member of every mesh
+        auto writeJoined = [&](Section& section, auto member){
+            beginSection(section);
+            section.size = 0;
+            for(auto& mesh: meshes){
+                auto& values = mesh.*member;
+                size_t size = values.size() * sizeof(values[0]);
+                file.write(reinterpret_cast<const char*>(values.data()), size);
+                section.size += size;
+            }
+        };
+
+        writeSection(header.meshes, entries.data(), entries.size() * sizeof(MeshEntry));
+        writeSection(header.surfaces, surfaces.data(), surfaces.size() * sizeof(SurfaceEntry));
+        writeJoined(header.meshlets, &Loader::MeshData::meshlets);
+        writeSection(header.dependencies, dependencyEntries.data(), dependencyEntries.size() * sizeof(DependencyEntry));
+        writeSection(header.names, names.data(), names.size());
+        beginSection(header.vertices);
+        header.vertices.size = 0;
+        for(auto& mesh: meshes){
+            std::vector<GPUVertex> vertices = VertexFormat::encode(mesh.vertices, mesh.vertexQuantization);
+            file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(GPUVertex));
+            header.vertices.size += vertices.size() * sizeof(GPUVertex);
+        }
+        writeJoined(header.indices, &Loader::MeshData::indices);
+        writeJoined(header.meshletVertices, &Loader::MeshData::meshletVertices);
+        writeJoined(header.meshletTriangles, &Loader::MeshData::meshletTriangles);
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+        return file.good();
+    }
+
+    // A mapped cache, checked once on open so the sections can be read without bounds checks
+    class CachedMeshes {
+    public:
+        // False when the file is missing, damaged or stale. sourcePath is the glTF file the cache stands in for
+        bool open(const std::filesystem::path& path, const std::filesystem::path& sourcePath){
+            if(!file.open(path) || file.size() < sizeof(Header)){
+                return false;
+            }
+
+            memcpy(&header, file.data(), sizeof(Header));
+            if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.vertexSize != sizeof(GPUVertex) || header.vertexFormat != VERTEX_FORMAT){
+                return false;
+            }
+
+            for(const Section* section: {&header.meshes, &header.surfaces, &header.meshlets, &header.dependencies, &header.names, &header.vertices, &header.indices, &header.meshletVertices, &header.meshletTriangles}){
+                if(section->offset % SECTION_ALIGNMENT != 0 || !inRange(section->offset, section->size, file.size())){
+                    return false;
+                }
+            }
+
+            if(!isFresh(sourcePath)){
+                return false;
+            }
+
+            if(meshes().size() != header.meshCount){
+                return false;
+            }
+
+            for(auto& mesh: meshes()){
+                if(!inRange(mesh.firstVertex, mesh.vertexCount, vertices().size()) || !inRange(mesh.firstIndex, mesh.indexCount, indices().size())
+                    || !inRange(mesh.firstSurface, mesh.surfaceCount, surfaces().size()) || !inRange(mesh.firstMeshlet, mesh.meshletCount, meshlets().size())
+                    || !inRange(mesh.firstMeshletVertex, mesh.meshletVertexCount, meshletVertices().size())
+                    || !inRange(mesh.firstMeshletTriangle, mesh.meshletTriangleSize, meshletTriangles().size())
+                    || !inRange(mesh.nameOffset, mesh.nameLength, header.names.size)){
+                    return false;
+                }
+
+                // surface ranges are local to their mesh and become indirect draws as they are
+                for(auto& surface: surfaces().subspan(mesh.firstSurface, mesh.surfaceCount)){
+                    if(!inRange(surface.startIndex, surface.count, mesh.indexCount) || !inRange(surface.firstMeshlet, surface.meshletCount, mesh.meshletCount)){
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        std::span<const MeshEntry> meshes() const { return section<MeshEntry>(header.meshes); }
+        std::span<const SurfaceEntry> surfaces() const { return section<SurfaceEntry>(header.surfaces); }
+        std::span<const Meshlet> meshlets() const { return section<Meshlet>(header.meshlets); }
+        std::span<const GPUVertex> vertices() const { return section<GPUVertex>(header.vertices); }
+        std::span<const uint32_t> indices() const { return section<uint32_t>(header.indices); }
+        std::span<const uint32_t> meshletVertices() const { return section<uint32_t>(header.meshletVertices); }
+        std::span<const uint8_t> meshletTriangles() const { return section<uint8_t>(header.meshletTriangles); }
+
+        std::span<const DependencyEntry> dependencies() const { return section<DependencyEntry>(header.dependencies); }
+
+        std::string_view name(const MeshEntry& mesh) const {
+            return nameAt(mesh.nameOffset, mesh.nameLength);
+        }
+
+    private:
+        Utility::MappedFile file;
+        Header header{};
+
+        static bool inRange(uint64_t first, uint64_t count, uint64_t size){
+            return first <= size && count <= size - first;
+        }
+
+        std::string_view nameAt(uint32_t offset, uint32_t length) const {
+            return std::string_view(reinterpret_cast<const char*>(file.data() + header.names.offset + offset), length);
+        }
+
+        // The first dependency is the source itself, every one must still have the content it was cached with.
+        // An unchanged size and write time is taken as unchanged content, anything else with the same size is hashed
+        bool isFresh(const std::filesystem::path& sourcePath) const {
+            std::span<const DependencyEntry> entries = dependencies();
+            if(entries.empty()){
+                return false;
+            }
+
+            std::filesystem::path directory = sourcePath.parent_path();
+            for(auto& entry: entries){
+                if(!inRange(entry.pathOffset, entry.pathLength, header.names.size)){
+                    return false;
+                }
+
+                std::string path(nameAt(entry.pathOffset, entry.pathLength));
+                if(&entry == &entries[0] && path != sourcePath.filename().generic_string()){
+                    return false;
+                }
+
+                uint64_t size;
+                int64_t lastWrite;
+                if(!statFile(directory / path, size, lastWrite) || size != entry.size){
+                    return false;
+                }
+
+                uint64_t hash;
+                if(lastWrite != entry.lastWrite && (!hashFile(directory / path, hash) || hash != entry.hash)){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // sections are aligned in the file and the mapping is page aligned, so they can be read in place
+        template<typename T>
+        std::span<const T> section(const Section& section) const {
+            return std::span<const T>(reinterpret_cast<const T*>(file.data() + section.offset), section.size / sizeof(T));
+        }
+    };
+};
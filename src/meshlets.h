@@ -0,0 +1,95 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+
+#include <algorithm>
+
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A small cluster of triangles with its own vertex list, the unit a mesh shader or cluster culling pass works on
+struct Meshlet {
+    uint32_t vertexOffset;      // into the mesh's meshlet vertices
+    uint32_t triangleOffset;    // into the mesh's meshlet triangles, in bytes, 3 per triangle
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    glm::vec4 bounds;           // bounding sphere of the meshlet's vertices
+};
+
+namespace Meshlets{
+    // Greedy split in index order: triangles are added until the next one would go over either limit.
+    // Appends to the outputs, meshletVertices are indices into vertices and triangles index into meshletVertices.
+    // slots maps a vertex to its slot in the current meshlet, UINT8_MAX when it isn't in it. It must be vertices.size()
+    // long and all UINT8_MAX, and is left that way, so the surfaces of a mesh can share one
+    void build(std::span<const Vertex> vertices, std::span<const uint32_t> indices, std::vector<Meshlet>& meshlets,
+        std::vector<uint32_t>& meshletVertices, std::vector<uint8_t>& meshletTriangles, std::vector<uint8_t>& slots){
+
+        Meshlet current{};
+        current.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+        current.triangleOffset = static_cast<uint32_t>(meshletTriangles.size());
+
+        auto finish = [&](){
+            if(current.triangleCount == 0){
+                return;
+            }
+
+            glm::vec3 minPos = vertices[meshletVertices[current.vertexOffset]].position;
+            glm::vec3 maxPos = minPos;
+            for (uint32_t i = 0; i < current.vertexCount; i++)
+            {
+                uint32_t vertex = meshletVertices[current.vertexOffset + i];
+                minPos = glm::min(minPos, vertices[vertex].position);
+                maxPos = glm::max(maxPos, vertices[vertex].position);
+                slots[vertex] = UINT8_MAX;
+            }
+
+            glm::vec3 center = (minPos + maxPos) * 0.5f;
+            float radius = 0.f;
+            for (uint32_t i = 0; i < current.vertexCount; i++)
+            {
+                radius = std::max(radius, glm::length(vertices[meshletVertices[current.vertexOffset + i]].position - center));
+            }
+            current.bounds = glm::vec4(center, radius);
+
+            meshlets.push_back(current);
+
+            current = Meshlet{};
+            current.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+            current.triangleOffset = static_cast<uint32_t>(meshletTriangles.size());
+        };
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            uint32_t corners[3] = {indices[i], indices[i + 1], indices[i + 2]};
+            if(corners[0] >= vertices.size() || corners[1] >= vertices.size() || corners[2] >= vertices.size()){
+                continue;
+            }
+
+            uint32_t newVertices = 0;
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                bool repeated = (c > 0 && corners[c] == corners[0]) || (c > 1 && corners[c] == corners[1]);
+                if(slots[corners[c]] == UINT8_MAX && !repeated){
+                    newVertices++;
+                }
+            }
+
+            if(current.vertexCount + newVertices > MESHLET_MAX_VERTICES || current.triangleCount + 1 > MESHLET_MAX_TRIANGLES){
+                finish();
+            }
+
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                if(slots[corners[c]] == UINT8_MAX){
+                    slots[corners[c]] = static_cast<uint8_t>(current.vertexCount++);
+                    meshletVertices.push_back(corners[c]);
+                }
+                meshletTriangles.push_back(slots[corners[c]]);
+            }
+            current.triangleCount++;
+        }
+
+        finish();
+    }
+};
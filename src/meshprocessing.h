@@ -0,0 +1,352 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+const uint32_t VERTEX_CACHE_SIZE = 32;      // LRU cache modelled by the vertex cache optimizer
+const uint32_t VERTEX_FIFO_SIZE = 16;       // FIFO cache used to measure and to find cluster boundaries
+
+// CPU passes that reorder a mesh for the GPU without changing what it draws. Indices are local to the mesh's
+// vertices and every index range passed in must be a whole surface, surfaces are never mixed. The per-surface passes
+// size their tables by vertexCount, so run them on a LocalSurface rather than the whole mesh
+namespace MeshProcessing{
+    struct VertexHash {
+        size_t operator()(const Vertex& vertex) const {
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&vertex);
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(Vertex); i++)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    struct VertexEqual {
+        bool operator()(const Vertex& a, const Vertex& b) const {
+            return memcmp(&a, &b, sizeof(Vertex)) == 0;
+        }
+    };
+
+    // Merges bit identical vertices, glTF primitives of one mesh often repeat each other's vertices
+    void deduplicateVertices(std::vector<Vertex>& vertices, std::span<uint32_t> indices){
+        std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> unique;
+        unique.reserve(vertices.size());
+
+        std::vector<uint32_t> remap(vertices.size());
+        std::vector<Vertex> result;
+        result.reserve(vertices.size());
+
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            auto [it, inserted] = unique.try_emplace(vertices[i], static_cast<uint32_t>(result.size()));
+            if(inserted){
+                result.push_back(vertices[i]);
+            }
+            remap[i] = it->second;
+        }
+
+        for(auto& index: indices){
+            index = remap[index];
+        }
+        vertices = std::move(result);
+    }
+
+    // A surface renumbered to its own vertices, so the passes' per-vertex tables are sized to the surface, not the mesh
+    struct LocalSurface {
+        std::vector<uint32_t> indices;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> meshVertices;     // local vertex to mesh vertex
+    };
+
+    // globalToLocal is scratch for the whole mesh: vertices.size() long and all UINT32_MAX, and left that way,
+    // so one table serves every surface and only the entries a surface used are reset
+    void toLocal(std::span<const uint32_t> indices, std::span<const Vertex> vertices, std::vector<uint32_t>& globalToLocal, LocalSurface& local){
+        local.indices.clear();
+        local.vertices.clear();
+        local.meshVertices.clear();
+
+        for(auto index: indices){
+            if(globalToLocal[index] == UINT32_MAX){
+                globalToLocal[index] = static_cast<uint32_t>(local.meshVertices.size());
+                local.meshVertices.push_back(index);
+                local.vertices.push_back(vertices[index]);
+            }
+            local.indices.push_back(globalToLocal[index]);
+        }
+
+        for(auto index: local.meshVertices){
+            globalToLocal[index] = UINT32_MAX;
+        }
+    }
+
+    void fromLocal(const LocalSurface& local, std::span<uint32_t> indices){
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            indices[i] = local.meshVertices[local.indices[i]];
+        }
+    }
+
+    // Average cache miss ratio, transformed vertices per triangle for a FIFO post-transform cache, 0.5 at best and 3 at worst
+    float averageCacheMissRatio(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize = VERTEX_FIFO_SIZE){
+        if(indices.size() < 3){
+            return 0.f;
+        }
+
+        // a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+        std::vector<uint32_t> loadedAt(vertexCount, 0);
+        uint32_t misses = 0;
+        for(auto index: indices){
+            if(loadedAt[index] == 0 || misses - loadedAt[index] >= cacheSize){
+                misses++;
+                loadedAt[index] = misses;
+            }
+        }
+        return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    }
+
+    // Forsyth's linear-speed vertex cache optimization: greedily emits the triangle whose vertices score best,
+    // favouring vertices that are recent in the cache and those with few triangles left
+    float vertexScore(int32_t cachePosition, uint32_t remainingTriangles){
+        if(remainingTriangles == 0){
+            return -1.f;
+        }
+
+        float score = 0.f;
+        if(cachePosition >= 0){
+            if(cachePosition < 3){
+                // the last triangle's vertices, fixed so the next triangle doesn't just reuse one edge forever
+                score = 0.75f;
+            } else {
+                score = std::pow(1.f - static_cast<float>(cachePosition - 3) / static_cast<float>(VERTEX_CACHE_SIZE - 3), 1.5f);
+            }
+        }
+        return score + 2.f / std::sqrt(static_cast<float>(remainingTriangles));
+    }
+
+    void optimizeVertexCache(std::span<uint32_t> indices, size_t vertexCount){
+        size_t triangleCount = indices.size() / 3;
+        if(triangleCount < 2){
+            return;
+        }
+
+        // triangles of every vertex, the live ones of vertex v are adjacency[offsets[v], offsets[v] + remaining[v])
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+        {
+            offsets[indices[i] + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            offsets[v + 1] += offsets[v];
+        }
+
+        std::vector<uint32_t> remaining(vertexCount, 0);
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+        {
+            uint32_t v = indices[i];
+            adjacency[offsets[v] + remaining[v]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        std::vector<int32_t> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            vertexScores[v] = vertexScore(-1, remaining[v]);
+        }
+
+        std::vector<float> triangleScores(triangleCount);
+        uint32_t best = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+            if(triangleScores[t] > triangleScores[best]){
+                best = static_cast<uint32_t>(t);
+            }
+        }
+
+        std::vector<uint8_t> emitted(triangleCount, 0);
+        std::vector<uint32_t> result;
+        result.reserve(triangleCount * 3);
+
+        uint32_t cache[VERTEX_CACHE_SIZE + 3];
+        uint32_t cacheCount = 0;
+        size_t nextTriangle = 0;    // fallback when no cached vertex has triangles left
+
+        while(best != UINT32_MAX){
+            uint32_t triangle[3] = {indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2]};
+            emitted[best] = 1;
+            result.insert(result.end(), triangle, triangle + 3);
+
+            // the triangle's vertices move to the front, the rest shift back and may fall out
+            uint32_t newCache[VERTEX_CACHE_SIZE + 3];
+            uint32_t newCount = 0;
+            for(auto v: triangle){
+                if(std::find(newCache, newCache + newCount, v) == newCache + newCount){
+                    newCache[newCount++] = v;
+                }
+            }
+            for (uint32_t i = 0; i < cacheCount; i++)
+            {
+                if(std::find(newCache, newCache + newCount, cache[i]) == newCache + newCount){
+                    newCache[newCount++] = cache[i];
+                }
+            }
+
+            for(auto v: triangle){
+                uint32_t* live = adjacency.data() + offsets[v];
+                std::swap(*std::find(live, live + remaining[v], best), live[remaining[v] - 1]);
+                remaining[v]--;
+            }
+
+            for (uint32_t i = 0; i < newCount; i++)
+            {
+                uint32_t v = newCache[i];
+                cachePositions[v] = i < VERTEX_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+                vertexScores[v] = vertexScore(cachePositions[v], remaining[v]);
+            }
+
+            // only triangles around vertices whose score just changed can change theirs
+            best = UINT32_MAX;
+            float bestScore = -1.f;
+            for (uint32_t i = 0; i < newCount; i++)
+            {
+                uint32_t v = newCache[i];
+                for (uint32_t j = 0; j < remaining[v]; j++)
+                {
+                    uint32_t t = adjacency[offsets[v] + j];
+                    triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                    if(triangleScores[t] > bestScore){
+                        bestScore = triangleScores[t];
+                        best = t;
+                    }
+                }
+            }
+
+            cacheCount = std::min(newCount, VERTEX_CACHE_SIZE);
+            std::copy(newCache, newCache + cacheCount, cache);
+
+            if(best == UINT32_MAX){
+                while(nextTriangle < triangleCount && emitted[nextTriangle]){
+                    nextTriangle++;
+                }
+                if(nextTriangle < triangleCount){
+                    best = static_cast<uint32_t>(nextTriangle);
+                }
+            }
+        }
+
+        std::copy(result.begin(), result.end(), indices.begin());
+    }
+
+    // Sander et al.'s fast triangle reordering: the cache optimized order is cut into clusters wherever a triangle
+    // misses the cache with all three vertices, which costs almost nothing to reorder at, and clusters facing away
+    // from the mesh's center are drawn first so they occlude the rest. Run after optimizeVertexCache
+    void optimizeOverdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices){
+        size_t triangleCount = indices.size() / 3;
+        if(triangleCount < 2){
+            return;
+        }
+
+        std::vector<uint32_t> clusterStarts;
+        std::vector<uint32_t> loadedAt(vertices.size(), 0);
+        uint32_t misses = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            uint32_t triangleMisses = 0;
+            for (size_t c = 0; c < 3; c++)
+            {
+                uint32_t index = indices[t * 3 + c];
+                if(loadedAt[index] == 0 || misses - loadedAt[index] >= VERTEX_FIFO_SIZE){
+                    misses++;
+                    triangleMisses++;
+                    loadedAt[index] = misses;
+                }
+            }
+            if(t == 0 || triangleMisses == 3){
+                clusterStarts.push_back(static_cast<uint32_t>(t));
+            }
+        }
+        clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+        size_t clusterCount = clusterStarts.size() - 1;
+        if(clusterCount < 2){
+            return;
+        }
+
+        // area weighted centroid and normal of every cluster
+        std::vector<glm::vec3> centroids(clusterCount);
+        std::vector<glm::vec3> normals(clusterCount);
+        glm::vec3 meshCentroid(0.f);
+        float meshArea = 0.f;
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            glm::vec3 centroid(0.f), normal(0.f);
+            float area = 0.f;
+            for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+            {
+                glm::vec3 a = vertices[indices[t * 3]].position;
+                glm::vec3 b = vertices[indices[t * 3 + 1]].position;
+                glm::vec3 d = vertices[indices[t * 3 + 2]].position;
+                glm::vec3 cross = glm::cross(b - a, d - a);
+                float triangleArea = glm::length(cross);
+
+                centroid += (a + b + d) * (triangleArea / 3.f);
+                normal += cross;
+                area += triangleArea;
+            }
+
+            centroids[c] = area > 0.f ? centroid / area : vertices[indices[clusterStarts[c] * 3]].position;
+            float length = glm::length(normal);
+            normals[c] = length > 0.f ? normal / length : glm::vec3(0.f);
+
+            meshCentroid += centroid;
+            meshArea += area;
+        }
+        if(meshArea > 0.f){
+            meshCentroid /= meshArea;
+        }
+
+        std::vector<float> sortKeys(clusterCount);
+        std::vector<uint32_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            sortKeys[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+            order[c] = static_cast<uint32_t>(c);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+            return sortKeys[a] > sortKeys[b];
+        });
+
+        std::vector<uint32_t> result;
+        result.reserve(triangleCount * 3);
+        for(auto c: order){
+            result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+        }
+        std::copy(result.begin(), result.end(), indices.begin());
+    }
+
+    // Renumbers vertices in the order the indices first use them, so vertex pulling walks memory forward.
+    // Vertices no index uses are dropped
+    void optimizeVertexFetch(std::vector<Vertex>& vertices, std::span<uint32_t> indices){
+        std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+        std::vector<Vertex> result;
+        result.reserve(vertices.size());
+
+        for(auto& index: indices){
+            if(remap[index] == UINT32_MAX){
+                remap[index] = static_cast<uint32_t>(result.size());
+                result.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices = std::move(result);
+    }
+};
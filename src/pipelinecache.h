@@ -0,0 +1,101 @@
+#pragma once
+
+#include "utils.h"
+
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+
+// VkPipelineCache kept on disk between runs. The file is only used when its header matches this device and driver,
+// anything else (other GPU, driver update, truncated file) starts from an empty cache.
+// The cache is internally synchronized so pipelines can be built with it from several threads.
+class PipelineCache {
+public:
+    VkPipelineCache cache = VK_NULL_HANDLE;
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, const std::filesystem::path& path){
+        this->device = device;
+        this->path = path;
+
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        std::vector<char> data = readCacheFile();
+        bool valid = isValid(data);
+        if(!data.empty() && !valid){
+            fmt::println("Pipeline cache {} is from another device or driver, starting empty", path.string());
+        }
+
+        VkPipelineCacheCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        createInfo.initialDataSize = valid ? data.size() : 0;
+        createInfo.pInitialData = valid ? data.data() : nullptr;
+
+        VK_CHECK(vkCreatePipelineCache(device, &createInfo, nullptr, &cache));
+    }
+
+    // Written to a temporary file first so a crash mid-write can't leave a broken cache behind
+    void save(){
+        size_t size = 0;
+        VK_CHECK(vkGetPipelineCacheData(device, cache, &size, nullptr));
+
+        std::vector<char> data(size);
+        VK_CHECK(vkGetPipelineCacheData(device, cache, &size, data.data()));
+
+        std::filesystem::path tempPath = path;
+        tempPath += ".tmp";
+
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if(!file.is_open()){
+                fmt::println("Failed to write pipeline cache {}", tempPath.string());
+                return;
+            }
+            file.write(data.data(), size);
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if(error){
+            fmt::println("Failed to write pipeline cache {}: {}", path.string(), error.message());
+        }
+    }
+
+    void destroy(){
+        vkDestroyPipelineCache(device, cache, nullptr);
+    }
+
+private:
+    VkDevice device;
+    VkPhysicalDeviceProperties properties;
+    std::filesystem::path path;
+
+    std::vector<char> readCacheFile(){
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if(!file.is_open()){
+            return {};
+        }
+
+        size_t fileSize = static_cast<size_t>(file.tellg());
+        std::vector<char> data(fileSize);
+
+        file.seekg(0);
+        file.read(data.data(), fileSize);
+
+        return data;
+    }
+
+    bool isValid(const std::vector<char>& data){
+        VkPipelineCacheHeaderVersionOne header;
+        if(data.size() < sizeof(header)){
+            return false;
+        }
+
+        memcpy(&header, data.data(), sizeof(header));
+
+        return header.headerSize >= sizeof(header) &&
+               header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               header.vendorID == properties.vendorID &&
+               header.deviceID == properties.deviceID &&
+               memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+};
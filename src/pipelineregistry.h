@@ -0,0 +1,197 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+
+#include <mutex>
+#include <future>
+#include <unordered_map>
+
+// Hands out one VkPipeline per distinct pipeline state, so permutations that end up identical are only compiled once.
+// Requests for a state that is still compiling on another thread wait for that build instead of starting their own.
+// Shader modules are part of the key by handle, and a handle only identifies a shader while it's alive:
+// call forgetShaders() before destroying the modules the pipelines were built from. The registry owns every pipeline.
+// A missing shader or failed build returns VK_NULL_HANDLE and isn't cached, so the next request tries again.
+class PipelineRegistry {
+public:
+    void init(VkDevice device, VkPipelineCache cache){
+        this->device = device;
+        this->cache = cache;
+    }
+
+    VkPipeline getPipeline(PipelineBuilder& builder){
+        for(auto& stage: builder.shaderStages){
+            if(stage.module == VK_NULL_HANDLE){
+                fmt::println("Missing shader module, graphics pipeline not built");
+                return VK_NULL_HANDLE;
+            }
+        }
+
+        return getOrBuild(graphicsStateKey(builder), [&](){
+            return builder.buildPipeline(device, cache);
+        });
+    }
+
+    VkPipeline getComputePipeline(VkShaderModule shader, VkPipelineLayout layout, const char* entry = "main"){
+        if(shader == VK_NULL_HANDLE){
+            fmt::println("Missing shader module, compute pipeline not built");
+            return VK_NULL_HANDLE;
+        }
+
+        StateKey key;
+        key.add('C');
+        key.add(shader);
+        key.add(layout);
+        key.addString(entry);
+
+        return getOrBuild(key.bytes, [&](){
+            VkComputePipelineCreateInfo pipelineInfo{};
+            pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipelineInfo.layout = layout;
+            pipelineInfo.stage = Initializers::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shader, entry);
+
+            VkPipeline pipeline;
+            if(vkCreateComputePipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS){
+                fmt::println("Failed to create compute pipeline!");
+                return VkPipeline(VK_NULL_HANDLE);
+            }
+            return pipeline;
+        });
+    }
+
+    // Pipelines stay alive, only lookups by the current shader handles are dropped
+    void forgetShaders(){
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+    }
+
+    void destroy(){
+        for(auto pipeline: built){
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+        built.clear();
+        entries.clear();
+    }
+
+private:
+    // Every field that ends up in the create info, appended value by value so padding and pNext pointers never count
+    struct StateKey {
+        std::string bytes;
+
+        template<typename T>
+        void add(const T& value){
+            bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void addString(const char* value){
+            bytes.append(value);
+            bytes.push_back('\0');
+        }
+    };
+
+    VkDevice device;
+    VkPipelineCache cache;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_future<VkPipeline>> entries;
+    std::vector<VkPipeline> built;
+
+    VkPipeline getOrBuild(const std::string& key, const std::function<VkPipeline()>& build){
+        std::promise<VkPipeline> promise;
+        std::shared_future<VkPipeline> existing;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto it = entries.find(key);
+            if(it != entries.end()){
+                existing = it->second;
+            } else {
+                entries.emplace(key, promise.get_future().share());
+            }
+        }
+
+        // built already or being built by another thread
+        if(existing.valid()){
+            return existing.get();
+        }
+
+        VkPipeline pipeline = build();
+        promise.set_value(pipeline);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(pipeline != VK_NULL_HANDLE){
+            built.push_back(pipeline);
+        } else {
+            // threads already waiting get the failure, later requests build again
+            entries.erase(key);
+        }
+
+        return pipeline;
+    }
+
+    static std::string graphicsStateKey(const PipelineBuilder& builder){
+        StateKey key;
+        key.add('G');
+
+        for(auto& stage: builder.shaderStages){
+            key.add(stage.stage);
+            key.add(stage.module);
+            key.addString(stage.pName);
+        }
+
+        key.add(builder.inputAssembly.topology);
+        key.add(builder.inputAssembly.primitiveRestartEnable);
+
+        const VkPipelineRasterizationStateCreateInfo& rasterizer = builder.rasterizer;
+        key.add(rasterizer.depthClampEnable);
+        key.add(rasterizer.rasterizerDiscardEnable);
+        key.add(rasterizer.polygonMode);
+        key.add(rasterizer.cullMode);
+        key.add(rasterizer.frontFace);
+        key.add(rasterizer.depthBiasEnable);
+        key.add(rasterizer.depthBiasConstantFactor);
+        key.add(rasterizer.depthBiasClamp);
+        key.add(rasterizer.depthBiasSlopeFactor);
+        key.add(rasterizer.lineWidth);
+
+        const VkPipelineColorBlendAttachmentState& blend = builder.colorBlendAttachment;
+        key.add(blend.blendEnable);
+        key.add(blend.srcColorBlendFactor);
+        key.add(blend.dstColorBlendFactor);
+        key.add(blend.colorBlendOp);
+        key.add(blend.srcAlphaBlendFactor);
+        key.add(blend.dstAlphaBlendFactor);
+        key.add(blend.alphaBlendOp);
+        key.add(blend.colorWriteMask);
+
+        const VkPipelineMultisampleStateCreateInfo& multisampling = builder.multisampling;
+        key.add(multisampling.rasterizationSamples);
+        key.add(multisampling.sampleShadingEnable);
+        key.add(multisampling.minSampleShading);
+        key.add(multisampling.alphaToCoverageEnable);
+        key.add(multisampling.alphaToOneEnable);
+
+        const VkPipelineDepthStencilStateCreateInfo& depthStencil = builder.depthStencil;
+        key.add(depthStencil.depthTestEnable);
+        key.add(depthStencil.depthWriteEnable);
+        key.add(depthStencil.depthCompareOp);
+        key.add(depthStencil.depthBoundsTestEnable);
+        key.add(depthStencil.stencilTestEnable);
+        key.add(depthStencil.front);
+        key.add(depthStencil.back);
+        key.add(depthStencil.minDepthBounds);
+        key.add(depthStencil.maxDepthBounds);
+
+        key.add(builder.pipelineLayout);
+
+        key.add(builder.renderInfo.colorAttachmentCount);
+        for (uint32_t i = 0; i < builder.renderInfo.colorAttachmentCount; i++)
+        {
+            key.add(builder.renderInfo.pColorAttachmentFormats[i]);
+        }
+        key.add(builder.renderInfo.depthAttachmentFormat);
+        key.add(builder.renderInfo.stencilAttachmentFormat);
+
+        return key.bytes;
+    }
+};
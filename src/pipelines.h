@@ -3,6 +3,7 @@
 #include "utils.h"
 #include <fstream>
 #include "initializers.h"
+#include "mappedfile.h"
 
 namespace Utility{
     std::vector<char> readFile(const std::string& filename){
@@ -25,12 +26,12 @@ namespace Utility{
         return buffer;
     }
 
-    VkShaderModule createShaderModule(const std::vector<char>& code, VkDevice device) {
+    VkShaderModule createShaderModule(const char* code, size_t size, VkDevice device) {
         VkShaderModuleCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-        
+        createInfo.codeSize = size;
+        createInfo.pCode = reinterpret_cast<const uint32_t*>(code);
+
         VkShaderModule shaderModule;
         if(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
             throw std::runtime_error("failed to create shader module");
@@ -38,11 +39,18 @@ namespace Utility{
 
         return shaderModule;
     }
+
+    VkShaderModule createShaderModule(const std::vector<char>& code, VkDevice device) {
+        return createShaderModule(code.data(), code.size(), device);
+    }
     
     bool loadShaderModule(const char* filename, VkDevice device, VkShaderModule* outShaderModule){
-        std::vector<char> buffer = readFile(filename);
+        MappedFile file(filename);
+        if(!file.isOpen()){
+            return false;
+        }
 
-        *outShaderModule = createShaderModule(buffer, device);
+        *outShaderModule = createShaderModule(reinterpret_cast<const char*>(file.data()), file.size(), device);
         return true;
     }
 };
\ No newline at end of file
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+
+#include <algorithm>
+#include <array>
+
+// GPU work measured with timestamp queries, one query pair per pass
+enum class GpuPass : uint32_t {
+    Background,
+    Culling,
+    Geometry,
+    DepthPyramid,
+    Blit,
+    Imgui,
+    Count
+};
+
+// Times GPU passes with timestamp queries written into each FrameData's own pool. Results are read back once the
+// frame's fence has signalled, so reading never waits on the GPU. Keeps a rolling window of samples per pass.
+class GpuProfiler {
+public:
+    static constexpr uint32_t PASS_COUNT = static_cast<uint32_t>(GpuPass::Count);
+    static constexpr uint32_t QUERY_COUNT = PASS_COUNT * 2;
+    static constexpr size_t HISTORY = 256;
+
+    struct Stats {
+        float min = 0.f;
+        float avg = 0.f;
+        float p99 = 0.f;
+        size_t samples = 0;
+    };
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily){
+        this->device = device;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod;
+
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+        enabled = queueFamily < familyCount && families[queueFamily].timestampValidBits > 0;
+        if(!enabled){
+            fmt::println("Timestamps aren't supported on the graphics queue, GPU profiling is off");
+        }
+    }
+
+    void createPool(FrameData& frame){
+        if(!enabled){
+            return;
+        }
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = QUERY_COUNT;
+
+        VK_CHECK(vkCreateQueryPool(device, &poolInfo, nullptr, &frame.timestampPool));
+        frame.timestampMask = 0;
+    }
+
+    void destroyPool(FrameData& frame){
+        if(frame.timestampPool != VK_NULL_HANDLE){
+            vkDestroyQueryPool(device, frame.timestampPool, nullptr);
+            frame.timestampPool = VK_NULL_HANDLE;
+        }
+    }
+
+    // Call after the frame's fence wait, picks up what the frame wrote the last time it was recorded.
+    // Returns true when the frame had timings, frameTime() is then that frame's GPU time.
+    bool collect(FrameData& frame){
+        if(!enabled || frame.timestampMask == 0){
+            return false;
+        }
+
+        // value and availability for every query
+        std::array<uint64_t, QUERY_COUNT * 2> results{};
+        VkResult result = vkGetQueryPoolResults(device, frame.timestampPool, 0, QUERY_COUNT, sizeof(results), results.data(),
+            sizeof(uint64_t) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+        if(result != VK_SUCCESS && result != VK_NOT_READY){
+            return false;
+        }
+
+        // first pass start to last pass end
+        uint64_t frameBegin = UINT64_MAX;
+        uint64_t frameEnd = 0;
+
+        for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+        {
+            if((frame.timestampMask & (1u << pass)) == 0){
+                continue;
+            }
+
+            const uint64_t* begin = &results[pass * 4];
+            const uint64_t* end = &results[pass * 4 + 2];
+            if(begin[1] == 0 || end[1] == 0 || end[0] < begin[0]){
+                continue;
+            }
+
+            addSample(pass, static_cast<float>((end[0] - begin[0]) * timestampPeriod / 1000000.0));
+
+            frameBegin = std::min(frameBegin, begin[0]);
+            frameEnd = std::max(frameEnd, end[0]);
+        }
+
+        frame.timestampMask = 0;
+
+        if(frameEnd < frameBegin){
+            return false;
+        }
+
+        lastFrameTime = static_cast<float>((frameEnd - frameBegin) * timestampPeriod / 1000000.0);
+        return true;
+    }
+
+    // Call at the start of recording, before any begin/end
+    void beginFrame(VkCommandBuffer command, FrameData& frame){
+        current = enabled ? &frame : nullptr;
+        if(current == nullptr){
+            return;
+        }
+
+        vkCmdResetQueryPool(command, frame.timestampPool, 0, QUERY_COUNT);
+        frame.timestampMask = 0;
+    }
+
+    void begin(VkCommandBuffer command, GpuPass pass){
+        if(current == nullptr){
+            return;
+        }
+
+        vkCmdWriteTimestamp2(command, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, current->timestampPool, static_cast<uint32_t>(pass) * 2);
+    }
+
+    void end(VkCommandBuffer command, GpuPass pass){
+        if(current == nullptr){
+            return;
+        }
+
+        vkCmdWriteTimestamp2(command, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, current->timestampPool, static_cast<uint32_t>(pass) * 2 + 1);
+        current->timestampMask |= 1u << static_cast<uint32_t>(pass);
+    }
+
+    Stats stats(GpuPass pass) const {
+        const History& history = histories[static_cast<uint32_t>(pass)];
+
+        Stats result;
+        result.samples = history.count;
+        if(history.count == 0){
+            return result;
+        }
+
+        std::vector<float> sorted(history.samples.begin(), history.samples.begin() + history.count);
+        std::sort(sorted.begin(), sorted.end());
+
+        float total = 0.f;
+        for(float sample: sorted){
+            total += sample;
+        }
+
+        result.min = sorted.front();
+        result.avg = total / sorted.size();
+        result.p99 = sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * 0.99f))];
+        return result;
+    }
+
+    static const char* passName(GpuPass pass){
+        static const char* names[] = {"Background", "Culling", "Geometry", "Depth pyramid", "Blit", "ImGui"};
+        return names[static_cast<uint32_t>(pass)];
+    }
+
+    bool isEnabled() const {
+        return enabled;
+    }
+
+    // Milliseconds, from the last collect() that returned true
+    float frameTime() const {
+        return lastFrameTime;
+    }
+
+private:
+    struct History {
+        std::array<float, HISTORY> samples{};
+        size_t count = 0;
+        size_t next = 0;
+    };
+
+    VkDevice device;
+    float timestampPeriod = 1.f;    // nanoseconds per tick
+    bool enabled = false;
+    float lastFrameTime = 0.f;
+
+    FrameData* current = nullptr;
+    std::array<History, PASS_COUNT> histories;
+
+    void addSample(uint32_t pass, float milliseconds){
+        History& history = histories[pass];
+        history.samples[history.next] = milliseconds;
+        history.next = (history.next + 1) % HISTORY;
+        history.count = std::min(history.count + 1, HISTORY);
+    }
+};
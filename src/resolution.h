@@ -0,0 +1,76 @@
+#pragma once
+
+#include "utils.h"
+
+// Picks how much of the window to render from measured GPU frame times, so a load spike costs resolution instead of
+// frame rate. Times are smoothed and the scale only moves once they leave a band around the target, then waits a
+// few frames to see the result (timings arrive frames in flight late), so it doesn't oscillate.
+class ResolutionScaler {
+public:
+    float minScale = 0.5f;
+    float maxScale = 1.f;
+    float lowerBand = 0.85f;    // grow once frames are this much under target
+    float upperBand = 1.f;      // shrink once they're over it
+    uint32_t cooldown = 8;      // frames between changes
+
+    // Returns true when the scale changed
+    bool update(float gpuMilliseconds, float targetMilliseconds){
+        smoothed = samples == 0 ? gpuMilliseconds : smoothed + (gpuMilliseconds - smoothed) * SMOOTHING;
+        samples++;
+
+        if(framesSinceChange < cooldown){
+            framesSinceChange++;
+            return false;
+        }
+
+        if(smoothed <= targetMilliseconds * upperBand && smoothed >= targetMilliseconds * lowerBand){
+            return false;
+        }
+
+        // cost mostly follows the pixel count, so the side length goes with the square root. Aim a little under the
+        // target, drop quickly when over and climb back slowly
+        float ratio = std::sqrt(targetMilliseconds * AIM / std::max(smoothed, 0.01f));
+        float next = std::clamp(current * std::clamp(ratio, MAX_SHRINK, MAX_GROW), minScale, maxScale);
+
+        if(std::abs(next - current) < 0.01f){
+            return false;
+        }
+
+        current = next;
+        framesSinceChange = 0;
+        return true;
+    }
+
+    void reset(){
+        current = maxScale;
+        smoothed = 0.f;
+        samples = 0;
+        framesSinceChange = 0;
+    }
+
+    float scale() const {
+        return current;
+    }
+
+    float smoothedTime() const {
+        return smoothed;
+    }
+
+    VkExtent2D extent(VkExtent2D full) const {
+        return {
+            std::max(1u, static_cast<uint32_t>(full.width * current)),
+            std::max(1u, static_cast<uint32_t>(full.height * current))
+        };
+    }
+
+private:
+    static constexpr float SMOOTHING = 0.1f;
+    static constexpr float AIM = 0.9f;
+    static constexpr float MAX_SHRINK = 0.8f;
+    static constexpr float MAX_GROW = 1.05f;
+
+    float current = 1.f;
+    float smoothed = 0.f;
+    uint64_t samples = 0;
+    uint32_t framesSinceChange = 0;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+// Shared by the engine and tests/ring_allocator_test.cpp, so only standard headers here
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+// Linear allocator over a ring of `capacity` bytes. Allocations made between two close() calls form one region,
+// regions are handed back in order once retire() sees the value they were closed with.
+// Values only have to increase, they can be frame numbers or timeline semaphore values.
+struct RingAllocator {
+    size_t capacity = 0;
+    size_t head = 0;    // next free byte
+    size_t tail = 0;    // oldest byte still in use
+    size_t used = 0;    // bytes between tail and head, alignment and wrap padding included
+
+    struct Region {
+        uint64_t retireValue;
+        size_t end;
+        size_t bytes;
+    };
+
+    std::deque<Region> inFlight;
+    size_t openBytes = 0;   // bytes allocated since the last close
+
+    void init(size_t size){
+        capacity = size;
+        head = tail = used = openBytes = 0;
+        inFlight.clear();
+    }
+
+    std::optional<size_t> allocate(size_t size, size_t alignment = 16){
+        if(size == 0 || size > capacity){
+            return std::nullopt;
+        }
+
+        if(used == 0){
+            head = tail = 0;
+        }
+
+        size_t offset = (head + alignment - 1) & ~(alignment - 1);
+
+        if(head >= tail && used < capacity){
+            if(offset + size <= capacity){
+                take(offset + size - head);
+                head = offset + size;
+                return offset;
+            }
+
+            // not enough room before the end, skip the rest and start over at 0
+            if(size <= tail){
+                take(capacity - head + size);
+                head = size;
+                return 0;
+            }
+        } else if(head < tail && offset + size <= tail){
+            take(offset + size - head);
+            head = offset + size;
+            return offset;
+        }
+
+        return std::nullopt;
+    }
+
+    // Everything allocated since the last close is freed once retire() is called with retireValue or higher
+    void close(uint64_t retireValue){
+        if(openBytes == 0){
+            return;
+        }
+
+        inFlight.push_back({retireValue, head, openBytes});
+        openBytes = 0;
+    }
+
+    void retire(uint64_t completedValue){
+        while(!inFlight.empty() && inFlight.front().retireValue <= completedValue){
+            used -= inFlight.front().bytes;
+            tail = inFlight.front().end;
+            inFlight.pop_front();
+        }
+    }
+
+    // Value the oldest region waits on, 0 when nothing is in flight
+    uint64_t oldestValue() const {
+        return inFlight.empty() ? 0 : inFlight.front().retireValue;
+    }
+
+private:
+    void take(size_t bytes){
+        used += bytes;
+        openBytes += bytes;
+    }
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+
+#include <algorithm>
+
+// Something to draw: one index range of a mesh with its own transform
+struct RenderObject {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    VkBuffer indexBuffer;
+    VkDeviceAddress vertexBuffer;
+    glm::vec4 vertexQuantization;   // of the mesh's vertices, see VertexFormat::quantization
+    glm::mat4 transform;
+    glm::vec4 bounds;       // object space bounding sphere, xyz center and w radius
+    UploadHandle upload;    // the mesh's upload, the object is drawn once it has landed
+};
+
+// Per-object data the vertex shader fetches with gl_InstanceIndex, matches ObjectData in shader.vert
+struct GPUObjectData {
+    glm::mat4 worldMatrix;
+    glm::vec4 boundingSphere;
+    glm::vec4 vertexQuantization;
+    VkDeviceAddress vertexBuffer;
+    uint32_t batchIndex;
+    uint32_t batchFirstCommand;     // where the culling pass compacts this batch's surviving commands
+};
+
+// Indirect commands sharing an index buffer, drawn with one vkCmdDrawIndexedIndirect
+struct IndirectBatch {
+    VkBuffer indexBuffer;
+    uint32_t firstCommand;
+    uint32_t commandCount;
+};
+
+// Camera and lighting for one frame, written to the frame's uniform ring, matches SceneData in scene.glsl
+struct GPUSceneData {
+    glm::mat4 view;
+    glm::mat4 proj;
+    glm::mat4 viewProj;
+    glm::mat4 prevViewProj;     // what the depth pyramid was rendered with
+    glm::vec4 cameraPosition;
+    glm::vec4 ambientColor;
+    glm::vec4 sunDirection;     // w is intensity
+    glm::vec4 sunColor;
+};
+
+struct GPUScenePushConstants {
+    VkDeviceAddress sceneData;
+    VkDeviceAddress objectBuffer;
+};
+
+// Matches the push constants in cull.comp
+struct CullPushConstants {
+    VkDeviceAddress sceneData;
+    VkDeviceAddress objectBuffer;
+    VkDeviceAddress commandBuffer;
+    VkDeviceAddress drawBuffer;
+    VkDeviceAddress countBuffer;
+    glm::vec2 pyramidSize;      // size of depth pyramid level 0
+    uint32_t objectCount;
+    uint32_t pyramidIndex;      // bindless sampled image of the whole pyramid
+    uint32_t pyramidLevels;
+    uint32_t cullFlags;
+};
+
+const uint32_t CULL_FRUSTUM = 1;
+const uint32_t CULL_OCCLUSION = 2;
+
+// Matches the push constants in depth_reduce.comp
+struct DepthReducePushConstants {
+    glm::uvec2 srcSize;
+    glm::uvec2 dstSize;
+    uint32_t srcIndex;      // sampled depth image for level 0, storage image of the previous level otherwise
+    uint32_t dstIndex;
+    uint32_t fromDepth;
+};
+
+// GPU copy of the scene, rebuilt only when objects change
+struct SceneBuffers {
+    AllocatedBuffer objectBuffer;
+    AllocatedBuffer indirectBuffer;     // every command, the culling pass reads from here
+    AllocatedBuffer drawBuffer;         // commands that survived culling, grouped per batch
+    AllocatedBuffer countBuffer;        // one draw count per batch
+    VkDeviceAddress objectBufferAddress;
+    VkDeviceAddress indirectBufferAddress;
+    VkDeviceAddress drawBufferAddress;
+    VkDeviceAddress countBufferAddress;
+    std::vector<IndirectBatch> batches;
+    uint32_t objectCount = 0;
+    UploadHandle upload;
+};
+
+namespace Scene{
+    // Sphere around the vertices' bounding box, good enough for culling
+    glm::vec4 computeBounds(std::span<const Vertex> vertices){
+        if(vertices.empty()){
+            return glm::vec4(0.f);
+        }
+
+        glm::vec3 minPos = vertices[0].position;
+        glm::vec3 maxPos = vertices[0].position;
+        for(auto& v: vertices){
+            minPos = glm::min(minPos, v.position);
+            maxPos = glm::max(maxPos, v.position);
+        }
+
+        glm::vec3 center = (minPos + maxPos) * 0.5f;
+
+        float radius = 0.f;
+        for(auto& v: vertices){
+            radius = std::max(radius, glm::length(v.position - center));
+        }
+
+        return glm::vec4(center, radius);
+    }
+
+    // Orders objects by index buffer and fills one object entry and one indirect command per object.
+    // The outputs and the sort keys live in the arena the outputs were made with
+    void buildDrawData(std::span<const RenderObject> objects, ArenaVector<GPUObjectData>& objectData, ArenaVector<VkDrawIndexedIndirectCommand>& commands, std::vector<IndirectBatch>& batches){
+        // sort keys instead of the objects, ties keep their insertion order
+        ArenaVector<uint32_t> order(objects.size(), ArenaAllocator<uint32_t>(objectData.get_allocator()));
+        for (uint32_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+            return objects[a].indexBuffer != objects[b].indexBuffer ? objects[a].indexBuffer < objects[b].indexBuffer : a < b;
+        });
+
+        objectData.resize(objects.size());
+        commands.resize(objects.size());
+        batches.clear();
+
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            const RenderObject& object = objects[order[i]];
+
+            if(batches.empty() || batches.back().indexBuffer != object.indexBuffer){
+                batches.push_back({object.indexBuffer, static_cast<uint32_t>(i), 0});
+            }
+            batches.back().commandCount++;
+
+            objectData[i].worldMatrix = object.transform;
+            objectData[i].boundingSphere = object.bounds;
+            objectData[i].vertexQuantization = object.vertexQuantization;
+            objectData[i].vertexBuffer = object.vertexBuffer;
+            objectData[i].batchIndex = static_cast<uint32_t>(batches.size() - 1);
+            objectData[i].batchFirstCommand = batches.back().firstCommand;
+
+            // firstInstance carries the object index through to gl_InstanceIndex
+            commands[i].indexCount = object.indexCount;
+            commands[i].instanceCount = 1;
+            commands[i].firstIndex = object.firstIndex;
+            commands[i].vertexOffset = 0;
+            commands[i].firstInstance = static_cast<uint32_t>(i);
+        }
+    }
+};
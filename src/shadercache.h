@@ -0,0 +1,76 @@
+#pragma once
+
+#include "utils.h"
+#include "pipelines.h"
+#include "mappedfile.h"
+
+#include <mutex>
+#include <unordered_map>
+
+// Shared VkShaderModules for SPIR-V files. Files are mapped instead of read into a copy, and modules are keyed by
+// content hash, so the same file (or two files with identical code) gives one module no matter how often it's asked for.
+// Thread safe. Modules belong to the cache, call clear() once the pipelines using them have been created.
+class ShaderCache {
+public:
+    void init(VkDevice device){
+        this->device = device;
+    }
+
+    VkShaderModule get(const std::string& path){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = byPath.find(path);
+            if(it != byPath.end()){
+                return it->second;
+            }
+        }
+
+        Utility::MappedFile file(path);
+        if(!file.isOpen() || file.size() % sizeof(uint32_t) != 0){
+            fmt::println("Failed to load shader {}", path);
+            return VK_NULL_HANDLE;
+        }
+
+        const char* code = reinterpret_cast<const char*>(file.data());
+        uint64_t hash = hashContents(code, file.size());
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // another thread may have created it while the file was being hashed
+        auto it = byHash.find(hash);
+        if(it == byHash.end()){
+            it = byHash.emplace(hash, Utility::createShaderModule(code, file.size(), device)).first;
+        }
+
+        byPath[path] = it->second;
+        return it->second;
+    }
+
+    void clear(){
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for(auto& [hash, shader]: byHash){
+            vkDestroyShaderModule(device, shader, nullptr);
+        }
+        byHash.clear();
+        byPath.clear();
+    }
+
+private:
+    VkDevice device;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, VkShaderModule> byPath;
+    std::unordered_map<uint64_t, VkShaderModule> byHash;
+
+    // FNV-1a, with the size mixed in
+    static uint64_t hashContents(const char* data, size_t size){
+        uint64_t hash = 14695981039346656037ull ^ size;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= static_cast<uint8_t>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+#include "ringallocator.h"
+
+#include <algorithm>
+
+struct StagingAllocation {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void* data;
+};
+
+// Persistently mapped staging buffer sub-allocated with a RingAllocator
+struct StagingRing {
+    AllocatedBuffer buffer;
+    RingAllocator ring;
+
+    void init(VmaAllocator allocator, size_t size){
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VmaAllocationCreateInfo vmaAllocInfo{};
+        vmaAllocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+        vmaAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &buffer.buffer, &buffer.allocation, &buffer.info));
+
+        ring.init(size);
+    }
+
+    void destroy(VmaAllocator allocator){
+        vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+    }
+
+    std::optional<StagingAllocation> allocate(size_t size, size_t alignment = 16){
+        std::optional<size_t> offset = ring.allocate(size, alignment);
+        if(!offset.has_value()){
+            return std::nullopt;
+        }
+
+        return StagingAllocation{buffer.buffer, offset.value(), static_cast<char*>(buffer.info.pMappedData) + offset.value()};
+    }
+};
+
+struct PendingCopy {
+    VkBuffer dst;
+    VkBufferCopy region;
+};
+
+struct PendingImageCopy {
+    VkImage dst;
+    VkBufferImageCopy region;
+    bool firstChunk;    // the image is moved from UNDEFINED to TRANSFER_DST_OPTIMAL before this copy
+};
+
+namespace Utility{
+    // One vkCmdCopyBuffer per destination, with neighbouring ranges merged into a single region.
+    // The sort order and regions are scratch memory from arena
+    void recordBufferCopies(VkCommandBuffer command, VkBuffer src, std::span<const PendingCopy> copies, LinearArena& arena){
+        // by destination, copies to the same buffer keep their queued order so neighbours stay next to each other
+        ArenaVector<uint32_t> order(copies.size(), ArenaAllocator<uint32_t>(arena));
+        for (uint32_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+            return copies[a].dst != copies[b].dst ? copies[a].dst < copies[b].dst : a < b;
+        });
+
+        ArenaVector<VkBufferCopy> regions{ArenaAllocator<VkBufferCopy>(arena)};
+        regions.reserve(copies.size());
+
+        for (size_t i = 0; i < order.size(); )
+        {
+            VkBuffer dst = copies[order[i]].dst;
+            regions.clear();
+
+            for(; i < order.size() && copies[order[i]].dst == dst; i++){
+                const VkBufferCopy& copy = copies[order[i]].region;
+                if(!regions.empty() && regions.back().srcOffset + regions.back().size == copy.srcOffset && regions.back().dstOffset + regions.back().size == copy.dstOffset){
+                    regions.back().size += copy.size;
+                } else {
+                    regions.push_back(copy);
+                }
+            }
+
+            vkCmdCopyBuffer(command, src, dst, static_cast<uint32_t>(regions.size()), regions.data());
+        }
+    }
+
+    // Copies into images left in TRANSFER_DST_OPTIMAL, every level of a new image is transitioned first with one barrier.
+    // Chunks of the same image are expected next to each other and go out as one vkCmdCopyBufferToImage
+    void recordImageCopies(VkCommandBuffer command, VkBuffer src, std::span<const PendingImageCopy> copies, LinearArena& arena){
+        if(copies.empty()){
+            return;
+        }
+
+        ArenaVector<VkImageMemoryBarrier2> barriers{ArenaAllocator<VkImageMemoryBarrier2>(arena)};
+        for(auto& copy: copies){
+            if(!copy.firstChunk){
+                continue;
+            }
+
+            VkImageMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+            barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = copy.dst;
+            barrier.subresourceRange = Initializers::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+            barriers.push_back(barrier);
+        }
+
+        if(!barriers.empty()){
+            VkDependencyInfo depInfo{};
+            depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            depInfo.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+            depInfo.pImageMemoryBarriers = barriers.data();
+
+            vkCmdPipelineBarrier2(command, &depInfo);
+        }
+
+        ArenaVector<VkBufferImageCopy> regions{ArenaAllocator<VkBufferImageCopy>(arena)};
+        regions.reserve(copies.size());
+
+        for (size_t i = 0; i < copies.size(); )
+        {
+            VkImage dst = copies[i].dst;
+            regions.clear();
+
+            for(; i < copies.size() && copies[i].dst == dst; i++){
+                regions.push_back(copies[i].region);
+            }
+
+            vkCmdCopyBufferToImage(command, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+        }
+    }
+};
@@ -1,29 +1,88 @@
 #pragma once
 
 #include "utils.h"
+#include "initializers.h"
+#include "arena.h"
 #include <span>
+#include <cstring>
 
+// Plain handles are recorded as typed entries, no closure, so queuing them never allocates once the vector has grown
+// to the busiest frame (clear keeps the capacity). Anything else can still go in as a function.
+// flush destroys the typed entries first, one type at a time so views go before images and pipelines before layouts,
+// then runs the functions newest first.
 struct DeletionQueue{
-    std::deque<std::function<void()>> deletors;
+    enum class Type : uint8_t {
+        ImageView,
+        Sampler,
+        Pipeline,
+        PipelineLayout,
+        Image,
+        Buffer,
+        Count
+    };
+
+    struct Entry {
+        Type type;
+        uint64_t handle;
+        VmaAllocation allocation;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;           // needed once typed entries are pushed
+    VmaAllocator allocator = VK_NULL_HANDLE;
+    std::vector<Entry> entries;
+    std::vector<std::function<void()>> deletors;
+
+    void init(VkDevice device, VmaAllocator allocator){
+        this->device = device;
+        this->allocator = allocator;
+    }
 
     void pushFunction(std::function<void()>&& function) {
-        deletors.push_back(function);
+        deletors.push_back(std::move(function));
     }
 
+    void pushBuffer(VkBuffer buffer, VmaAllocation allocation){ push(Type::Buffer, buffer, allocation); }
+    void pushImage(VkImage image, VmaAllocation allocation){ push(Type::Image, image, allocation); }
+    void pushImageView(VkImageView view){ push(Type::ImageView, view); }
+    void pushSampler(VkSampler sampler){ push(Type::Sampler, sampler); }
+    void pushPipeline(VkPipeline pipeline){ push(Type::Pipeline, pipeline); }
+    void pushPipelineLayout(VkPipelineLayout layout){ push(Type::PipelineLayout, layout); }
+
     void flush() {
+        for (uint32_t type = 0; type < static_cast<uint32_t>(Type::Count); type++)
+        {
+            for(auto& entry: entries){
+                if(static_cast<uint32_t>(entry.type) == type){
+                    destroy(entry);
+                }
+            }
+        }
+        entries.clear();
+
         for(auto it = deletors.rbegin(); it != deletors.rend(); it++){
             (*it)();
         }
         deletors.clear();
     }
-};
 
-struct FrameData {
-    VkCommandPool commandPool;
-    VkCommandBuffer mainCommandBuffer;
-    VkSemaphore swapchainSemaphore, renderSemaphore;
-    VkFence renderFence;
-    DeletionQueue deletionQueue;
+private:
+    // non-dispatchable handles are pointers on 64 bit and uint64_t on 32 bit, a C cast covers both
+    template<typename T>
+    void push(Type type, T handle, VmaAllocation allocation = VK_NULL_HANDLE){
+        entries.push_back({type, (uint64_t)handle, allocation});
+    }
+
+    void destroy(const Entry& entry){
+        switch(entry.type){
+            case Type::ImageView: vkDestroyImageView(device, (VkImageView)entry.handle, nullptr); break;
+            case Type::Sampler: vkDestroySampler(device, (VkSampler)entry.handle, nullptr); break;
+            case Type::Pipeline: vkDestroyPipeline(device, (VkPipeline)entry.handle, nullptr); break;
+            case Type::PipelineLayout: vkDestroyPipelineLayout(device, (VkPipelineLayout)entry.handle, nullptr); break;
+            case Type::Image: vmaDestroyImage(allocator, (VkImage)entry.handle, entry.allocation); break;
+            case Type::Buffer: vmaDestroyBuffer(allocator, (VkBuffer)entry.handle, entry.allocation); break;
+            default: break;
+        }
+    }
 };
 
 struct AllocatedImage {
@@ -35,13 +94,19 @@ struct AllocatedImage {
     VkFormat imageFormat;
 };
 
+struct AllocatedBuffer{
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    VmaAllocationInfo info;
+};
+
 struct DescriptorLayoutBuilder {
     std::vector<VkDescriptorSetLayoutBinding> bindings;
 
-    void addBinding(uint32_t binding, VkDescriptorType type){
+    void addBinding(uint32_t binding, VkDescriptorType type, uint32_t count = 1){
         VkDescriptorSetLayoutBinding newBind{};
         newBind.binding = binding;
-        newBind.descriptorCount = 1;
+        newBind.descriptorCount = count;
         newBind.descriptorType = type;
 
         bindings.push_back(newBind);
@@ -72,54 +137,234 @@ struct DescriptorLayoutBuilder {
     }
 };
 
-struct DescriptorAllocator {
+// Descriptor allocator that never runs out: when a pool is exhausted a new, larger one is chained on.
+// clearPools() resets every pool at once, so it works as a per-frame allocator for transient sets.
+struct DescriptorAllocatorGrowable {
     struct PoolSizeRatio{
         VkDescriptorType type;
         float ratio;
     };
 
-    VkDescriptorPool pool;
+    void init(VkDevice device, uint32_t initialSets, std::span<PoolSizeRatio> poolRatios){
+        ratios.assign(poolRatios.begin(), poolRatios.end());
+
+        readyPools.push_back(createPool(device, initialSets));
+
+        // next pool is bigger, so a busy allocator settles on a few large pools
+        setsPerPool = growSetCount(initialSets);
+    }
+
+    void clearPools(VkDevice device){
+        for(auto pool: readyPools){
+            vkResetDescriptorPool(device, pool, 0);
+        }
+
+        for(auto pool: fullPools){
+            vkResetDescriptorPool(device, pool, 0);
+            readyPools.push_back(pool);
+        }
+        fullPools.clear();
+    }
+
+    void destroyPools(VkDevice device){
+        for(auto pool: readyPools){
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+        readyPools.clear();
+
+        for(auto pool: fullPools){
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+        fullPools.clear();
+    }
+
+    VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout, void* pNext = nullptr){
+        VkDescriptorPool pool = getPool(device);
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.pNext = pNext;
+        allocInfo.descriptorPool = pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        VkDescriptorSet ds;
+        VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &ds);
+
+        // pool ran out, park it until the next clear and retry once with a fresh one
+        if(result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL){
+            fullPools.push_back(pool);
+
+            pool = getPool(device);
+            allocInfo.descriptorPool = pool;
+
+            VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &ds));
+        } else {
+            VK_CHECK(result);
+        }
 
-    void initPool(VkDevice device, uint32_t maxSets, std::span<PoolSizeRatio> poolRatios){
+        readyPools.push_back(pool);
+        return ds;
+    }
+
+private:
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4092;
+
+    std::vector<PoolSizeRatio> ratios;
+    std::vector<VkDescriptorPool> fullPools;
+    std::vector<VkDescriptorPool> readyPools;
+    uint32_t setsPerPool = 0;
+
+    static uint32_t growSetCount(uint32_t sets){
+        return std::min(MAX_SETS_PER_POOL, sets + sets / 2);
+    }
+
+    VkDescriptorPool getPool(VkDevice device){
+        if(!readyPools.empty()){
+            VkDescriptorPool pool = readyPools.back();
+            readyPools.pop_back();
+            return pool;
+        }
+
+        VkDescriptorPool pool = createPool(device, setsPerPool);
+        setsPerPool = growSetCount(setsPerPool);
+        return pool;
+    }
+
+    VkDescriptorPool createPool(VkDevice device, uint32_t setCount){
         std::vector<VkDescriptorPoolSize> poolSizes;
-        for(PoolSizeRatio ratio: poolRatios){
+        for(PoolSizeRatio ratio: ratios){
             poolSizes.push_back(VkDescriptorPoolSize{
                 .type = ratio.type,
-                .descriptorCount = static_cast<uint32_t>(ratio.ratio * maxSets)
+                .descriptorCount = std::max(1u, static_cast<uint32_t>(ratio.ratio * setCount))
             });
         }
 
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         poolInfo.flags = 0;
-        poolInfo.maxSets = maxSets;
+        poolInfo.maxSets = setCount;
         poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
         poolInfo.pPoolSizes = poolSizes.data();
 
-        vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool);
-    } 
+        VkDescriptorPool newPool;
+        VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &newPool));
+        return newPool;
+    }
+};
 
-    void clearDescriptors(VkDevice device){
-        vkResetDescriptorPool(device, pool, 0);
+// Present modes that can be picked with --present-mode and in the UI
+struct PresentModeName {
+    VkPresentModeKHR mode;
+    const char* name;
+};
+
+const PresentModeName PRESENT_MODES[] = {
+    {VK_PRESENT_MODE_FIFO_KHR, "fifo"},                     // vsync, always supported, most latency
+    {VK_PRESENT_MODE_MAILBOX_KHR, "mailbox"},               // vsync but the newest frame replaces queued ones
+    {VK_PRESENT_MODE_IMMEDIATE_KHR, "immediate"},           // no vsync, lowest latency, tears
+    {VK_PRESENT_MODE_FIFO_RELAXED_KHR, "fifo_relaxed"}      // vsync unless a frame is late, then it tears
+};
+
+// Startup settings, filled from the command line in main.cpp
+struct EngineOptions {
+    bool headless = false;          // no window or surface, frames go to offscreen images
+    uint32_t frameCount = 0;        // stop after this many frames, 0 runs until the window is closed
+    std::string dumpPath;           // headless only, directory frames are written to as .ppm
+    uint32_t dumpInterval = 1;      // dump every nth frame
+    uint32_t frameOverlap = DEFAULT_FRAME_OVERLAP;          // frames in flight, 1 to MAX_FRAME_OVERLAP
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    bool dynamicResolution = false; // scale the rendered resolution to keep GPU time under frameBudget
+    std::string statsPath;          // frame time histogram written here on exit, .json or .csv
+    double frameBudget = FRAME_BUDGET_MS;
+    std::string tracePath;          // CPU zones are written here as a Chrome trace on exit, empty turns tracing off
+};
+
+struct UniformAllocation {
+    void* data;
+    VkDeviceSize offset;        // for dynamic uniform offsets into buffer
+    VkDeviceAddress address;    // for buffer_reference in shaders
+};
+
+// Persistently mapped host visible buffer that a frame bump allocates its uniform data from: camera, lighting and
+// anything else written once per frame or per draw. Every FrameData owns one and resets it after its fence wait,
+// so nothing is overwritten while the GPU can still read it. Offsets respect minUniformBufferOffsetAlignment.
+struct UniformRing {
+    AllocatedBuffer buffer;
+    VkDeviceAddress address = 0;
+    size_t capacity = 0;
+    size_t head = 0;
+    VkDeviceSize alignment = 256;
+
+    void init(VkDevice device, VmaAllocator allocator, size_t size, VkDeviceSize minAlignment){
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        // small and rewritten every frame, host visible device memory when there is some.
+        // Coherent so writes through allocate() are visible at submit without a vmaFlushAllocation per push
+        VmaAllocationCreateInfo vmaAllocInfo{};
+        vmaAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+        vmaAllocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        vmaAllocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+        VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &buffer.buffer, &buffer.allocation, &buffer.info));
+
+        VkBufferDeviceAddressInfo addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = buffer.buffer;
+        address = vkGetBufferDeviceAddress(device, &addressInfo);
+
+        capacity = size;
+        head = 0;
+        alignment = std::max<VkDeviceSize>(minAlignment, 16);
     }
 
-    void destroyPool(VkDevice device){
-        vkDestroyDescriptorPool(device, pool, nullptr);
+    void destroy(VmaAllocator allocator){
+        vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
     }
 
-    VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout){
-        VkDescriptorSetAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.pNext = nullptr;
-        allocInfo.descriptorPool = pool;
-        allocInfo.descriptorSetCount = 1;
-        allocInfo.pSetLayouts = &layout;
+    std::optional<UniformAllocation> allocate(size_t size){
+        size_t offset = (head + alignment - 1) & ~(alignment - 1);
+        if(offset + size > capacity){
+            fmt::println("Frame uniform ring is full ({} bytes)", capacity);
+            return std::nullopt;
+        }
 
-        VkDescriptorSet ds;
-        VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &ds));
+        head = offset + size;
+        return UniformAllocation{static_cast<char*>(buffer.info.pMappedData) + offset, offset, address + offset};
+    }
 
-        return ds;
+    // Copies value in and returns where the GPU sees it, 0 when the ring is full
+    template<typename T>
+    VkDeviceAddress push(const T& value){
+        std::optional<UniformAllocation> allocation = allocate(sizeof(T));
+        if(!allocation.has_value()){
+            return 0;
+        }
+
+        memcpy(allocation->data, &value, sizeof(T));
+        return allocation->address;
     }
+
+    void reset(){
+        head = 0;
+    }
+};
+
+struct FrameData {
+    VkCommandPool commandPool;
+    VkCommandBuffer mainCommandBuffer;
+    VkSemaphore swapchainSemaphore, renderSemaphore;
+    VkFence renderFence;
+    DeletionQueue deletionQueue;
+    DescriptorAllocatorGrowable frameDescriptors;   // reset in bulk once renderFence signals
+    VkQueryPool timestampPool = VK_NULL_HANDLE;     // GpuProfiler queries, read back once renderFence signals
+    uint32_t timestampMask = 0;                     // passes written the last time this frame was recorded
+    LinearArena arena;                              // transient CPU data, reset once renderFence signals
+    UniformRing uniforms;                           // per-frame GPU constants, reset once renderFence signals
 };
 
 struct ComputePushConstants{
@@ -127,6 +372,7 @@ struct ComputePushConstants{
     glm::vec4 data2;
     glm::vec4 data3;
     glm::vec4 data4;
+    uint32_t imageIndex;    // bindless storage image to write to
 };
 
 struct ComputeEffect{
@@ -138,12 +384,7 @@ struct ComputeEffect{
     ComputePushConstants data;
 };
 
-struct AllocatedBuffer{
-    VkBuffer buffer;
-    VmaAllocation allocation;
-    VmaAllocationInfo info;
-};
-
+// CPU side vertex, the vertex buffers hold it encoded as GPUVertex (vertexformat.h)
 struct Vertex {
     glm::vec3 position;
     float uv_x;
@@ -152,15 +393,17 @@ struct Vertex {
     glm::vec4 color;
 };
 
+// Timeline value an async upload completes on
+struct UploadHandle{
+    uint64_t value = 0;
+};
+
 struct GPUMeshBuffers{
     AllocatedBuffer indexBuffer;
     AllocatedBuffer vertexBuffer;
     VkDeviceAddress vertexBufferAddress;
-};
-
-struct GPUDrawPushConstants{
-    glm::mat4 worldMatrix;
-    VkDeviceAddress vertexBuffer;
+    glm::vec4 vertexQuantization{0.f, 0.f, 0.f, 1.f};
+    UploadHandle upload;
 };
 
 class PipelineBuilder {
@@ -198,7 +441,7 @@ class PipelineBuilder {
             shaderStages.clear();
         }
 
-        VkPipeline buildPipeline(VkDevice device){
+        VkPipeline buildPipeline(VkDevice device, VkPipelineCache cache = VK_NULL_HANDLE){
             VkPipelineViewportStateCreateInfo viewportState{};
             viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
             viewportState.pNext = nullptr;
@@ -241,7 +484,7 @@ class PipelineBuilder {
             pipelineInfo.pDynamicState = &dynamicInfo;
 
             VkPipeline newPipeline;
-            if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS) {
+            if(vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS) {
                 fmt::println("Failed to create pipeline!");
                 return VK_NULL_HANDLE;
             }
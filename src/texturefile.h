@@ -0,0 +1,184 @@
+#pragma once
+
+// Shared by the engine and tools/texturecooker.cpp, so only standard and Vulkan headers here
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+#include "mappedfile.h"
+
+// Cooked texture container (.ctex), a cut down KTX2: a header, one Level entry per mip, then every level's payload
+// largest first, each starting at a LEVEL_ALIGNMENT offset. Payloads are already in the GPU layout of vkFormat,
+// block compressed or not, so the runtime maps the file and copies levels straight into staging.
+namespace TextureFile{
+    const char MAGIC[8] = {'C', 'T', 'E', 'X', '\r', '\n', 0x1a, '\n'};
+    const uint32_t VERSION = 1;
+    const uint64_t LEVEL_ALIGNMENT = 16;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t vkFormat;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels;
+        uint32_t blockSize;         // texels along a block edge, 1 for uncompressed formats
+        uint32_t bytesPerBlock;     // bytes per texel for uncompressed formats
+        uint32_t reserved;
+    };
+
+    struct Level {
+        uint64_t offset;    // from the start of the file
+        uint64_t size;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    static_assert(sizeof(Header) == 40 && sizeof(Level) == 24, "the file layout must not depend on the compiler");
+
+    uint64_t levelSize(uint32_t width, uint32_t height, uint32_t blockSize, uint32_t bytesPerBlock){
+        uint64_t blocksWide = (width + blockSize - 1) / blockSize;
+        uint64_t blocksHigh = (height + blockSize - 1) / blockSize;
+        return blocksWide * blocksHigh * bytesPerBlock;
+    }
+
+    // Block edge and bytes per block of the formats a .ctex may hold, false for any other format
+    bool blockLayout(VkFormat format, uint32_t& blockSize, uint32_t& bytesPerBlock){
+        switch(format){
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+                blockSize = 1;
+                bytesPerBlock = 4;
+                return true;
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+                blockSize = 4;
+                bytesPerBlock = 8;
+                return true;
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+                blockSize = 4;
+                bytesPerBlock = 16;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Levels in a full chain down to 1x1
+    uint32_t maxMipLevels(uint32_t width, uint32_t height){
+        uint32_t levels = 1;
+        for(uint32_t size = std::max(width, height); size > 1; size >>= 1){
+            levels++;
+        }
+        return levels;
+    }
+
+    bool write(const std::filesystem::path& path, Header header, std::span<const std::vector<uint8_t>> levels){
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if(!file.is_open()){
+            return false;
+        }
+
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.mipLevels = static_cast<uint32_t>(levels.size());
+
+        std::vector<Level> entries(levels.size());
+        uint64_t offset = sizeof(Header) + sizeof(Level) * levels.size();
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            offset = (offset + LEVEL_ALIGNMENT - 1) & ~(LEVEL_ALIGNMENT - 1);
+            entries[i].offset = offset;
+            entries[i].size = levels[i].size();
+            entries[i].width = std::max(1u, header.width >> i);
+            entries[i].height = std::max(1u, header.height >> i);
+            offset += levels[i].size();
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(reinterpret_cast<const char*>(entries.data()), sizeof(Level) * entries.size());
+
+        const char padding[LEVEL_ALIGNMENT] = {};
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            file.write(padding, entries[i].offset - static_cast<uint64_t>(file.tellp()));
+            file.write(reinterpret_cast<const char*>(levels[i].data()), levels[i].size());
+        }
+
+        return file.good();
+    }
+
+    // A mapped .ctex, checked once on open so the levels can be read without bounds checks and the header can be
+    // used to create the image as it is
+    class CookedTexture {
+    public:
+        bool open(const std::filesystem::path& path){
+            if(!file.open(path) || file.size() < sizeof(Header)){
+                return false;
+            }
+
+            memcpy(&header, file.data(), sizeof(Header));
+            if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION){
+                return false;
+            }
+
+            if(header.width == 0 || header.height == 0 || header.mipLevels == 0 || header.mipLevels > maxMipLevels(header.width, header.height)){
+                return false;
+            }
+
+            uint32_t blockSize, bytesPerBlock;
+            if(!blockLayout(static_cast<VkFormat>(header.vkFormat), blockSize, bytesPerBlock)
+                || header.blockSize != blockSize || header.bytesPerBlock != bytesPerBlock){
+                return false;
+            }
+
+            if(sizeof(Header) + sizeof(Level) * header.mipLevels > file.size()){
+                return false;
+            }
+
+            levels.resize(header.mipLevels);
+            memcpy(levels.data(), file.data() + sizeof(Header), sizeof(Level) * header.mipLevels);
+
+            for (uint32_t i = 0; i < header.mipLevels; i++)
+            {
+                const Level& level = levels[i];
+                if(level.width != std::max(1u, header.width >> i) || level.height != std::max(1u, header.height >> i)){
+                    return false;
+                }
+
+                if(level.offset > file.size() || level.size > file.size() - level.offset
+                    || level.size < levelSize(level.width, level.height, header.blockSize, header.bytesPerBlock)){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const Header& info() const {
+            return header;
+        }
+
+        const Level& level(uint32_t index) const {
+            return levels[index];
+        }
+
+        const uint8_t* levelData(uint32_t index) const {
+            return file.data() + levels[index].offset;
+        }
+
+    private:
+        Utility::MappedFile file;
+        Header header{};
+        std::vector<Level> levels;
+    };
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+#include "bindless.h"
+#include "jobs.h"
+#include "texturefile.h"
+
+#include <mutex>
+#include <filesystem>
+#include <unordered_map>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Decoded pixels, always 4 channel RGBA8 so every texture shares one upload and sampling path
+struct ImageData {
+    std::string name;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Sampled image with a full mip chain. The pixels are uploaded on the transfer queue, then the first frame that sees
+// the upload done blits the mips (cooked textures bring their own) on the graphics queue.
+// bindlessIndex is only valid once ready is set.
+struct Texture {
+    std::string name;
+    AllocatedImage image;
+    uint32_t mipLevels = 1;
+    VkSampler sampler = VK_NULL_HANDLE;
+    uint32_t bindlessIndex = BindlessTable::INVALID_INDEX;
+    UploadHandle upload;
+    bool generateMips = true;   // only level 0 was uploaded
+    bool ready = false;
+};
+
+// One VkSampler per distinct sampler state, owned by the cache. Thread safe
+class SamplerCache {
+public:
+    void init(VkDevice device){
+        this->device = device;
+    }
+
+    VkSampler getSampler(const VkSamplerCreateInfo& info){
+        std::string key = samplerKey(info);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = samplers.find(key);
+        if(it != samplers.end()){
+            return it->second;
+        }
+
+        VkSampler sampler;
+        VK_CHECK(vkCreateSampler(device, &info, nullptr, &sampler));
+        samplers.emplace(key, sampler);
+        return sampler;
+    }
+
+    // Trilinear, repeating, every mip level
+    static VkSamplerCreateInfo linearRepeat(){
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+        return samplerInfo;
+    }
+
+    size_t size(){
+        std::lock_guard<std::mutex> lock(mutex);
+        return samplers.size();
+    }
+
+    void destroy(){
+        for(auto& [key, sampler]: samplers){
+            vkDestroySampler(device, sampler, nullptr);
+        }
+        samplers.clear();
+    }
+
+private:
+    VkDevice device;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, VkSampler> samplers;
+
+    // Field by field so padding and pNext never count
+    static std::string samplerKey(const VkSamplerCreateInfo& info){
+        std::string key;
+        auto add = [&](const auto& value){
+            key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+        add(info.flags);
+        add(info.magFilter);
+        add(info.minFilter);
+        add(info.mipmapMode);
+        add(info.addressModeU);
+        add(info.addressModeV);
+        add(info.addressModeW);
+        add(info.mipLodBias);
+        add(info.anisotropyEnable);
+        add(info.maxAnisotropy);
+        add(info.compareEnable);
+        add(info.compareOp);
+        add(info.minLod);
+        add(info.maxLod);
+        add(info.borderColor);
+        add(info.unnormalizedCoordinates);
+        return key;
+    }
+};
+
+namespace Textures{
+    std::optional<ImageData> decodeImage(const std::filesystem::path& filePath){
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(filePath.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if(pixels == nullptr){
+            fmt::println("Failed to decode {}: {}", filePath.string(), stbi_failure_reason());
+            return std::nullopt;
+        }
+
+        ImageData image;
+        image.name = filePath.filename().string();
+        image.width = static_cast<uint32_t>(width);
+        image.height = static_cast<uint32_t>(height);
+        image.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+
+        stbi_image_free(pixels);
+        return image;
+    }
+
+    // Decodes every file on the worker pool and hands each image to consume on the calling thread as soon as it's
+    // done, in whatever order they finish. Files that fail are skipped. The image is freed once consume returns
+    void decodeImages(std::span<const std::filesystem::path> filePaths, Jobs::WorkerPool& workers, const std::function<void(ImageData&)>& consume){
+        if(workers.threadCount() == 0){
+            for(auto& path: filePaths){
+                std::optional<ImageData> image = decodeImage(path);
+                if(image.has_value()){
+                    consume(image.value());
+                }
+            }
+            return;
+        }
+
+        // shared with the tasks, the last one may still be notifying after this returns
+        struct Decoded {
+            std::mutex mutex;
+            std::condition_variable ready;
+            std::deque<std::optional<ImageData>> images;
+        };
+        auto decoded = std::make_shared<Decoded>();
+
+        for(auto& path: filePaths){
+            workers.submit([decoded, path](){
+                Trace::Zone zone("Decode image");
+                std::optional<ImageData> image = decodeImage(path);
+                {
+                    std::lock_guard<std::mutex> lock(decoded->mutex);
+                    decoded->images.push_back(std::move(image));
+                }
+                decoded->ready.notify_one();
+            });
+        }
+
+        for (size_t i = 0; i < filePaths.size(); i++)
+        {
+            std::optional<ImageData> image;
+            {
+                std::unique_lock<std::mutex> lock(decoded->mutex);
+                decoded->ready.wait(lock, [&](){ return !decoded->images.empty(); });
+                image = std::move(decoded->images.front());
+                decoded->images.pop_front();
+            }
+
+            if(image.has_value()){
+                consume(image.value());
+            }
+        }
+    }
+};
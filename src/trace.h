@@ -0,0 +1,189 @@
+#pragma once
+
+#include "utils.h"
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <fstream>
+
+// CPU zones written to the Chrome trace event format (load the file in chrome://tracing or ui.perfetto.dev).
+// Every thread records into its own fixed size buffer, so a zone costs two clock reads and a store, no locks.
+// Recording is off until start() is called and stops for a thread once its buffer is full. A thread's buffer is
+// only allocated when it records its first event.
+namespace Trace{
+    const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    struct Event {
+        const char* name;   // must outlive the trace, string literals
+        int64_t start;      // nanoseconds since start()
+        int64_t duration;
+    };
+
+    struct ThreadBuffer {
+        std::unique_ptr<Event[]> events = std::make_unique<Event[]>(EVENTS_PER_THREAD);
+        std::atomic<size_t> count{0};      // published with release so write() can read while the thread keeps going
+        std::atomic<size_t> dropped{0};
+        uint32_t id = 0;
+        std::string name;
+    };
+
+    struct State {
+        std::atomic<bool> enabled{false};
+        std::chrono::steady_clock::time_point origin;
+
+        std::mutex mutex;   // only taken the first time a thread records and when writing
+        std::vector<std::unique_ptr<ThreadBuffer>> threads;
+    };
+
+    State& state(){
+        static State state;
+        return state;
+    }
+
+    // Name given by setThreadName, kept outside the buffer so naming a thread doesn't allocate its events
+    std::string& threadName(){
+        thread_local std::string name;
+        return name;
+    }
+
+    ThreadBuffer*& currentBuffer(){
+        thread_local ThreadBuffer* buffer = nullptr;
+        return buffer;
+    }
+
+    // Created on the thread's first recorded event, so threads never traced cost nothing
+    ThreadBuffer& threadBuffer(){
+        ThreadBuffer*& buffer = currentBuffer();
+        if(buffer == nullptr){
+            State& s = state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+
+            s.threads.push_back(std::make_unique<ThreadBuffer>());
+            buffer = s.threads.back().get();
+            buffer->id = static_cast<uint32_t>(s.threads.size());
+            buffer->name = threadName().empty() ? fmt::format("Thread {}", buffer->id) : threadName();
+        }
+        return *buffer;
+    }
+
+    int64_t now(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - state().origin).count();
+    }
+
+    void start(){
+        state().origin = std::chrono::steady_clock::now();
+        state().enabled.store(true, std::memory_order_relaxed);
+    }
+
+    void stop(){
+        state().enabled.store(false, std::memory_order_relaxed);
+    }
+
+    bool isEnabled(){
+        return state().enabled.load(std::memory_order_relaxed);
+    }
+
+    // Shown as the track name in the viewer, call from the thread itself
+    void setThreadName(const std::string& name){
+        threadName() = name;
+
+        ThreadBuffer* buffer = currentBuffer();
+        if(buffer != nullptr){
+            std::lock_guard<std::mutex> lock(state().mutex);
+            buffer->name = name;
+        }
+    }
+
+    void record(const char* name, int64_t start, int64_t end){
+        ThreadBuffer& buffer = threadBuffer();
+
+        // only this thread writes count, so a relaxed load is enough here
+        size_t index = buffer.count.load(std::memory_order_relaxed);
+        if(index >= EVENTS_PER_THREAD){
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer.events[index] = {name, start, end - start};
+        buffer.count.store(index + 1, std::memory_order_release);
+    }
+
+    // Times the enclosing scope: Trace::Zone zone("Fence wait");
+    class Zone {
+    public:
+        explicit Zone(const char* name): name(name){
+            if(isEnabled()){
+                start = now();
+            }
+        }
+
+        ~Zone(){
+            end();
+        }
+
+        // Ends the zone before the scope does, for phases that don't line up with a block
+        void end(){
+            if(start >= 0 && isEnabled()){
+                record(name, start, now());
+            }
+            start = -1;
+        }
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+    private:
+        const char* name;
+        int64_t start = -1;
+    };
+
+    // Writes every event recorded so far, safe to call while other threads are still recording
+    bool write(const std::string& path){
+        std::ofstream file(path, std::ios::trunc);
+        if(!file.is_open()){
+            fmt::println("Failed to write trace {}", path);
+            return false;
+        }
+
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        file << "{\"traceEvents\":[\n";
+
+        bool first = true;
+        auto separator = [&](){
+            if(!first){
+                file << ",\n";
+            }
+            first = false;
+        };
+
+        size_t eventCount = 0;
+        size_t droppedCount = 0;
+        for(auto& thread: s.threads){
+            separator();
+            file << fmt::format(R"({{"name":"thread_name","ph":"M","pid":0,"tid":{},"args":{{"name":"{}"}}}})", thread->id, thread->name);
+
+            size_t count = thread->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < count; i++)
+            {
+                const Event& event = thread->events[i];
+                separator();
+                file << fmt::format(R"({{"name":"{}","ph":"X","pid":0,"tid":{},"ts":{:.3f},"dur":{:.3f}}})",
+                    event.name, thread->id, event.start / 1000.0, event.duration / 1000.0);
+            }
+
+            eventCount += count;
+            droppedCount += thread->dropped.load(std::memory_order_relaxed);
+        }
+
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+        fmt::println("Wrote {} trace events to {}", eventCount, path);
+        if(droppedCount > 0){
+            fmt::println("{} trace events were dropped after a thread's buffer filled up", droppedCount);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include "utils.h"
+#include "initializers.h"
+#include "structs.h"
+#include "staging.h"
+
+// Streams data into GPU buffers and images on its own queue without blocking the CPU.
+// Copies are staged in one persistently mapped ring and grouped into batches, every batch is one submit that
+// signals a timeline semaphore. Staging space is recycled once the batch that used it has signalled.
+// Not thread safe, call it from the thread that submits frames.
+class UploadQueue {
+public:
+    VkQueue queue;
+    uint32_t queueFamily;
+    VkSemaphore timeline;
+
+    void init(VkDevice device, VmaAllocator allocator, VkQueue queue, uint32_t queueFamily, size_t stagingSize = 64 * 1024 * 1024, uint32_t batchCount = 4){
+        this->device = device;
+        this->allocator = allocator;
+        this->queue = queue;
+        this->queueFamily = queueFamily;
+
+        // big uploads are split so one of them can't hold the whole ring
+        maxChunkSize = stagingSize / 4;
+
+        VkSemaphoreTypeCreateInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        timelineInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo = Initializers::semaphoreCreateInfo();
+        semaphoreInfo.pNext = &timelineInfo;
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline));
+
+        staging.init(allocator, stagingSize);
+
+        VkCommandPoolCreateInfo poolInfo = Initializers::commandPoolCreateInfo(queueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+        batches.resize(batchCount);
+        for(auto& batch: batches){
+            VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &batch.commandPool));
+
+            VkCommandBufferAllocateInfo allocInfo = Initializers::commandBufferAllocateInfo(batch.commandPool, 1);
+            VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &batch.command));
+        }
+
+        current = 0;
+        batches[current].value = nextValue;
+    }
+
+    void destroy(){
+        for(auto& batch: batches){
+            vkDestroyCommandPool(device, batch.commandPool, nullptr);
+        }
+        batches.clear();
+
+        staging.destroy(allocator);
+        vkDestroySemaphore(device, timeline, nullptr);
+    }
+
+    // Queues a copy of size bytes into dst, data is copied out before this returns.
+    // Only blocks when the staging ring is full of copies the GPU hasn't finished yet.
+    UploadHandle uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, size_t size){
+        const char* src = static_cast<const char*>(data);
+
+        while(size > 0){
+            size_t chunk = std::min(size, maxChunkSize);
+
+            std::optional<StagingAllocation> allocation = staging.allocate(chunk);
+            if(!allocation.has_value()){
+                // submit what we have and wait for the oldest batch to give its space back
+                flush();
+                waitValue(staging.ring.oldestValue());
+                continue;
+            }
+
+            memcpy(allocation->data, src, chunk);
+
+            VkBufferCopy copy{};
+            copy.srcOffset = allocation->offset;
+            copy.dstOffset = dstOffset;
+            copy.size = chunk;
+            batches[current].copies.push_back({dst, copy});
+
+            src += chunk;
+            dstOffset += chunk;
+            size -= chunk;
+        }
+
+        return UploadHandle{batches[current].value};
+    }
+
+    // Queues a copy of tightly packed pixels into level 0 of image, every level is left in TRANSFER_DST_OPTIMAL.
+    // The image must be usable from both queue families (concurrent sharing) and is split by rows into chunks.
+    // Empty when a single row doesn't fit in the staging ring, see canUploadImage()
+    std::optional<UploadHandle> uploadImage(VkImage dst, VkExtent2D extent, const void* data, uint32_t bytesPerPixel){
+        return uploadImageLevel(dst, 0, extent, data, 1, bytesPerPixel, true);
+    }
+
+    // Same for one level of any format, block compressed ones give their block edge in texels and bytes per block.
+    // newImage moves every level from UNDEFINED first, so it's only set for the first level uploaded
+    std::optional<UploadHandle> uploadImageLevel(VkImage dst, uint32_t mipLevel, VkExtent2D extent, const void* data, uint32_t blockSize, uint32_t bytesPerBlock, bool newImage){
+        if(!canUploadImage(extent, blockSize, bytesPerBlock)){
+            return std::nullopt;
+        }
+
+        const char* src = static_cast<const char*>(data);
+        size_t rowSize = imageRowSize(extent, blockSize, bytesPerBlock);
+        uint32_t blockRows = (extent.height + blockSize - 1) / blockSize;
+        uint32_t rowsPerChunk = static_cast<uint32_t>(std::max<size_t>(1, maxChunkSize / rowSize));
+
+        uint32_t row = 0;
+        while(row < blockRows){
+            uint32_t rows = std::min(rowsPerChunk, blockRows - row);
+            size_t chunk = rows * rowSize;
+
+            // offsets into the staging buffer must be a multiple of the texel or block size
+            std::optional<StagingAllocation> allocation = staging.allocate(chunk, std::max<size_t>(16, bytesPerBlock));
+            if(!allocation.has_value()){
+                flush();
+                waitValue(staging.ring.oldestValue());
+                continue;
+            }
+
+            memcpy(allocation->data, src + row * rowSize, chunk);
+
+            uint32_t y = row * blockSize;
+
+            VkBufferImageCopy copy{};
+            copy.bufferOffset = allocation->offset;
+            copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copy.imageSubresource.mipLevel = mipLevel;
+            copy.imageSubresource.layerCount = 1;
+            copy.imageOffset = {0, static_cast<int32_t>(y), 0};
+            copy.imageExtent = {extent.width, std::min(rows * blockSize, extent.height - y), 1};
+            batches[current].imageCopies.push_back({dst, copy, newImage && row == 0});
+
+            row += rows;
+        }
+
+        return UploadHandle{batches[current].value};
+    }
+
+    // Images are staged at least one row of texels or blocks at a time, so a row wider than the whole ring would
+    // wait for space forever. Check before creating an image that will be uploaded here
+    bool canUploadImage(VkExtent2D extent, uint32_t blockSize, uint32_t bytesPerBlock) const {
+        return blockSize > 0 && bytesPerBlock > 0 && imageRowSize(extent, blockSize, bytesPerBlock) <= staging.ring.capacity;
+    }
+
+    // Submits everything queued since the last flush, the engine calls this once per frame
+    void flush(){
+        Batch& batch = batches[current];
+        if(batch.copies.empty() && batch.imageCopies.empty()){
+            return;
+        }
+
+        VkCommandBufferBeginInfo beginInfo = Initializers::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        VK_CHECK(vkBeginCommandBuffer(batch.command, &beginInfo));
+
+        Utility::recordBufferCopies(batch.command, staging.buffer.buffer, batch.copies, scratch);
+        Utility::recordImageCopies(batch.command, staging.buffer.buffer, batch.imageCopies, scratch);
+        scratch.reset();
+
+        VK_CHECK(vkEndCommandBuffer(batch.command));
+
+        VkCommandBufferSubmitInfo commandInfo = Initializers::commandBufferSubmitInfo(batch.command);
+        VkSemaphoreSubmitInfo signalInfo = Initializers::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timeline);
+        signalInfo.value = batch.value;
+
+        VkSubmitInfo2 submit = Initializers::submitInfo(&commandInfo, &signalInfo, nullptr);
+        VK_CHECK(vkQueueSubmit2(queue, 1, &submit, VK_NULL_HANDLE));
+
+        // the staging used by this batch comes back once its value is signalled
+        staging.ring.close(batch.value);
+
+        submitted = batch.value;
+        nextValue++;
+
+        // move on to the next batch, this only blocks when every batch is still in flight
+        current = (current + 1) % batches.size();
+        Batch& next = batches[current];
+
+        waitValue(next.value);
+        VK_CHECK(vkResetCommandPool(device, next.commandPool, 0));
+        next.copies.clear();
+        next.imageCopies.clear();
+        next.value = nextValue;
+    }
+
+    bool isComplete(UploadHandle handle){
+        if(handle.value <= completed){
+            return true;
+        }
+
+        VK_CHECK(vkGetSemaphoreCounterValue(device, timeline, &completed));
+        staging.ring.retire(completed);
+        return handle.value <= completed;
+    }
+
+    // Blocks until the upload is done, flushing it first if it was still queued
+    void wait(UploadHandle handle){
+        if(handle.value > submitted){
+            flush();
+        }
+        waitValue(handle.value);
+    }
+
+    // Last value seen as signalled, graphics submits wait on it so finished uploads are visible to them
+    uint64_t completedValue() const {
+        return completed;
+    }
+
+private:
+    struct Batch {
+        VkCommandPool commandPool;
+        VkCommandBuffer command;
+        uint64_t value = 0;     // timeline value signalled once this batch's copies are done
+        std::vector<PendingCopy> copies;
+        std::vector<PendingImageCopy> imageCopies;
+    };
+
+    LinearArena scratch;    // for recording, reset after every flush
+
+    VkDevice device;
+    VmaAllocator allocator;
+
+    StagingRing staging;
+    size_t maxChunkSize = 0;
+
+    std::vector<Batch> batches;
+    size_t current = 0;
+
+    uint64_t nextValue = 1;
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+
+    void waitValue(uint64_t value){
+        if(value <= completed){
+            return;
+        }
+
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+
+        VK_CHECK(vkWaitSemaphores(device, &waitInfo, 9999999999));
+        completed = std::max(completed, value);
+        staging.ring.retire(completed);
+    }
+
+    static size_t imageRowSize(VkExtent2D extent, uint32_t blockSize, uint32_t bytesPerBlock){
+        return static_cast<size_t>((extent.width + blockSize - 1) / blockSize) * bytesPerBlock;
+    }
+};
@@ -31,7 +31,26 @@ const uint32_t WIDTH = 800, HEIGHT = 600;
 
 const bool USE_VALIDATION_LAYERS = true;
 
-const uint32_t FRAME_OVERLAP = 2; // I think same as MAX_FRAMES_IN_FLIGHT
+const uint32_t DEFAULT_FRAME_OVERLAP = 2; // frames the CPU may record ahead of the GPU, can be changed at runtime
+const uint32_t MAX_FRAME_OVERLAP = 4;
+
+const size_t FRAME_STAGING_SIZE = 8 * 1024 * 1024; // staging for per-frame uploads, shared by all frames in flight
+
+const size_t FRAME_ARENA_SIZE = 256 * 1024; // first block of each frame's arena for transient CPU data, grows if needed
+
+const size_t FRAME_UNIFORM_SIZE = 1024 * 1024; // each frame's uniform ring for camera, lighting and other per-frame GPU data
+
+const double FRAME_BUDGET_MS = 1000.0 / 60.0; // frames slower than this count as over budget in the frame stats
+
+const uint32_t HEADLESS_FRAME_COUNT = 300; // frames rendered by --headless when --frames isn't given
+
+const char* const PIPELINE_CACHE_PATH = "pipeline_cache.bin"; // saved on exit, reused when the device and driver match
+
+const char* const DEFAULT_SCENE_PATH = "static\\scene.glb"; // loaded at startup if it exists
+
+const char* const DEFAULT_TEXTURE_DIRECTORY = "static"; // every .png/.jpg in it is loaded at startup
+
+const VkFormat TEXTURE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB; // decoded images are RGBA8 with sRGB color
 
 // MACRO for VK_SUCCESS check
 #define VK_CHECK(x)                                                     \
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+
+// Layout of the GPU vertex buffers, picked at build time with the VERTEX_FORMAT CMake option, which also passes
+// the same define to glslc so shaders/vertex.glsl decodes what the engine encodes. Meshes are loaded as Vertex
+// and encoded on upload or when the mesh cache is written, so the cache holds vertices ready for the GPU.
+//   FLOAT      48 bytes, Vertex as is
+//   HALF       20 bytes, half float positions, for meshes whose object space stays within a few thousand units
+//   SNORM16    20 bytes, 16 bit positions within the mesh's bounds, see quantization()
+// Both packed formats store octahedral snorm16 normals, half float UVs and RGBA8 color.
+#define VERTEX_FORMAT_FLOAT 0
+#define VERTEX_FORMAT_HALF 1
+#define VERTEX_FORMAT_SNORM16 2
+
+#ifndef VERTEX_FORMAT
+#define VERTEX_FORMAT VERTEX_FORMAT_FLOAT
+#endif
+
+#if VERTEX_FORMAT == VERTEX_FORMAT_FLOAT
+using GPUVertex = Vertex;
+#else
+// Matches PackedVertex in vertex.glsl, every member is a uint so std430 packs it the same way
+struct GPUVertex {
+    uint32_t positionXY;
+    uint32_t positionZ;     // z in the low half
+    uint32_t normal;        // octahedral, snorm16 x2
+    uint32_t uv;            // half x2
+    uint32_t color;         // unorm8 x4
+};
+
+static_assert(sizeof(GPUVertex) == 20, "GPUVertex must match PackedVertex in vertex.glsl");
+#endif
+
+namespace VertexFormat{
+    // Maps a unit vector onto the octahedron and unfolds it into [-1, 1]^2
+    glm::vec2 octahedralEncode(glm::vec3 normal){
+        float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if(sum == 0.f){
+            return glm::vec2(0.f);
+        }
+
+        glm::vec2 encoded = glm::vec2(normal.x, normal.y) / sum;
+        if(normal.z < 0.f){
+            glm::vec2 sign(encoded.x >= 0.f ? 1.f : -1.f, encoded.y >= 0.f ? 1.f : -1.f);
+            encoded = (1.f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+        }
+        return encoded;
+    }
+
+    // Object space position = xyz + stored position * w, where the stored position is in [-1, 1] for SNORM16.
+    // xyz is the center of the vertices' bounding box and w its largest half extent. Identity for the other formats
+    glm::vec4 quantization(std::span<const Vertex> vertices){
+#if VERTEX_FORMAT == VERTEX_FORMAT_SNORM16
+        if(vertices.empty()){
+            return glm::vec4(0.f, 0.f, 0.f, 1.f);
+        }
+
+        glm::vec3 minPos = vertices[0].position;
+        glm::vec3 maxPos = minPos;
+        for(auto& vertex: vertices){
+            minPos = glm::min(minPos, vertex.position);
+            maxPos = glm::max(maxPos, vertex.position);
+        }
+
+        glm::vec3 halfExtent = (maxPos - minPos) * 0.5f;
+        float scale = std::max(std::max(halfExtent.x, halfExtent.y), halfExtent.z);
+        return glm::vec4((minPos + maxPos) * 0.5f, scale > 0.f ? scale : 1.f);
+#else
+        (void)vertices;
+        return glm::vec4(0.f, 0.f, 0.f, 1.f);
+#endif
+    }
+
+    GPUVertex encode(const Vertex& vertex, glm::vec4 quantization){
+#if VERTEX_FORMAT == VERTEX_FORMAT_FLOAT
+        (void)quantization;
+        return vertex;
+#else
+        GPUVertex encoded;
+#if VERTEX_FORMAT == VERTEX_FORMAT_HALF
+        (void)quantization;
+        encoded.positionXY = glm::packHalf2x16(glm::vec2(vertex.position.x, vertex.position.y));
+        encoded.positionZ = glm::packHalf2x16(glm::vec2(vertex.position.z, 0.f));
+#else
+        glm::vec3 position = (vertex.position - glm::vec3(quantization)) / quantization.w;
+        encoded.positionXY = glm::packSnorm2x16(glm::vec2(position.x, position.y));
+        encoded.positionZ = glm::packSnorm2x16(glm::vec2(position.z, 0.f));
+#endif
+        encoded.normal = glm::packSnorm2x16(octahedralEncode(vertex.normal));
+        encoded.uv = glm::packHalf2x16(glm::vec2(vertex.uv_x, vertex.uv_y));
+        encoded.color = glm::packUnorm4x8(vertex.color);
+        return encoded;
+#endif
+    }
+
+    std::vector<GPUVertex> encode(std::span<const Vertex> vertices, glm::vec4 quantization){
+        std::vector<GPUVertex> encoded(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            encoded[i] = encode(vertices[i], quantization);
+        }
+        return encoded;
+    }
+};
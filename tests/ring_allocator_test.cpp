@@ -0,0 +1,131 @@
+// CPU-only checks for RingAllocator (src/ringallocator.h): wraparound, out of space, and retirement by fence value.
+// The fence values are made up, retire() is called with whatever a timeline semaphore or frame fence would report.
+#include "ringallocator.h"
+
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(x)                                                        \
+    do {                                                                \
+        if(!(x)){                                                       \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #x); \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static void testAlignment(){
+    RingAllocator ring;
+    ring.init(256);
+
+    CHECK(ring.allocate(10) == 0u);
+    CHECK(ring.allocate(10) == 16u);
+    CHECK(ring.allocate(4, 64) == 64u);
+    CHECK(ring.used == 68u);
+}
+
+static void testWraparound(){
+    RingAllocator ring;
+    ring.init(256);
+
+    CHECK(ring.allocate(100) == 0u);
+    ring.close(1);
+    CHECK(ring.allocate(100) == 112u);
+    ring.close(2);
+
+    // 212..256 is too small, and the start is still owned by frame 1
+    CHECK(!ring.allocate(80).has_value());
+
+    ring.retire(1);
+    CHECK(ring.tail == 100u);
+
+    // skips the end of the buffer and starts over at 0, the skipped bytes count as used until frame 3 retires
+    CHECK(ring.allocate(80) == 0u);
+    CHECK(ring.used == 212u - 100u + (256u - 212u) + 80u);
+    ring.close(3);
+
+    // head is behind tail now, only the gap up to tail is free
+    CHECK(!ring.allocate(32).has_value());
+    CHECK(ring.allocate(16) == 80u);
+    ring.close(4);
+
+    ring.retire(4);
+    CHECK(ring.used == 0u);
+    CHECK(ring.inFlight.empty());
+
+    // an empty ring starts over at 0
+    CHECK(ring.allocate(200) == 0u);
+}
+
+static void testOutOfSpace(){
+    RingAllocator ring;
+    ring.init(128);
+
+    CHECK(!ring.allocate(0).has_value());
+    CHECK(!ring.allocate(129).has_value());
+
+    CHECK(ring.allocate(128) == 0u);
+    ring.close(1);
+    CHECK(!ring.allocate(1).has_value());
+
+    // nothing is freed before its value is reached
+    ring.retire(0);
+    CHECK(!ring.allocate(1).has_value());
+    CHECK(ring.oldestValue() == 1u);
+
+    ring.retire(1);
+    CHECK(ring.oldestValue() == 0u);
+    CHECK(ring.allocate(128) == 0u);
+}
+
+static void testOutOfOrderRetire(){
+    RingAllocator ring;
+    ring.init(1024);
+
+    CHECK(ring.allocate(100) == 0u);
+    ring.close(5);
+    CHECK(ring.allocate(100) == 112u);
+    ring.close(7);
+    CHECK(ring.allocate(100) == 224u);
+    ring.close(9);
+
+    // closing with nothing allocated doesn't add a region
+    ring.close(10);
+    CHECK(ring.inFlight.size() == 3u);
+
+    // a value that skips past several regions frees all of them at once
+    ring.retire(8);
+    CHECK(ring.inFlight.size() == 1u);
+    CHECK(ring.tail == 212u);
+    CHECK(ring.oldestValue() == 9u);
+
+    // an older value reported late changes nothing
+    ring.retire(5);
+    CHECK(ring.inFlight.size() == 1u);
+    CHECK(ring.tail == 212u);
+
+    // regions are freed in order: one closed with a smaller value waits behind the one before it
+    CHECK(ring.allocate(100) == 336u);
+    ring.close(3);
+    ring.retire(3);
+    CHECK(ring.inFlight.size() == 2u);
+    CHECK(ring.tail == 212u);
+
+    ring.retire(9);
+    CHECK(ring.inFlight.empty());
+    CHECK(ring.used == 0u);
+}
+
+int main(){
+    testAlignment();
+    testWraparound();
+    testOutOfSpace();
+    testOutOfOrderRetire();
+
+    if(failures != 0){
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("RingAllocator: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,47 @@
+// Offline mesh converter: parses a .gltf/.glb once and writes the binary cache the engine would otherwise write
+// on its first launch (see src/meshcache.h).
+//   MeshConverter input [output]     output defaults to input + ".cmesh", where the engine looks for it
+#include "meshcache.h"
+
+int main(int argc, char* argv[]){
+    if(argc < 2 || argc > 3){
+        fmt::println("Usage: MeshConverter input.gltf|input.glb [output.cmesh]");
+        return 1;
+    }
+
+    std::filesystem::path input = argv[1];
+    std::filesystem::path output = argc == 3 ? std::filesystem::path(argv[2]) : MeshCache::cachePath(input);
+
+    std::optional<std::vector<MeshCache::Dependency>> dependencies = MeshCache::collectDependencies(input);
+    if(!dependencies.has_value()){
+        fmt::println("Failed to open {}", input.string());
+        return 1;
+    }
+
+    Jobs::WorkerPool workers;
+    workers.start();
+    std::optional<std::vector<Loader::MeshData>> meshes = Loader::loadGltfMeshes(input, workers);
+    workers.stop();
+
+    if(!meshes.has_value()){
+        return 1;
+    }
+
+    if(!MeshCache::write(output, dependencies.value(), meshes.value())){
+        fmt::println("Failed to write {}", output.string());
+        return 1;
+    }
+
+    size_t vertexCount = 0, indexCount = 0, meshletCount = 0;
+    double transformedVertices = 0.0;
+    for(auto& mesh: meshes.value()){
+        vertexCount += mesh.vertices.size();
+        indexCount += mesh.indices.size();
+        meshletCount += mesh.meshlets.size();
+        transformedVertices += MeshProcessing::averageCacheMissRatio(mesh.indices, mesh.vertices.size()) * (mesh.indices.size() / 3);
+    }
+
+    fmt::println("Converted {} ({} meshes, {} vertices, {} triangles, {} meshlets, ACMR {:.3f})", output.string(), meshes->size(), vertexCount, indexCount / 3,
+        meshletCount, indexCount >= 3 ? transformedVertices / (indexCount / 3) : 0.0);
+    return 0;
+}
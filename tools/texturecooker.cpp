@@ -0,0 +1,370 @@
+// Offline texture cooker: turns a PNG/JPEG into a .ctex (see src/texturefile.h) with every mip level
+// pre-generated and block compressed, so the engine never decodes or blits at load time.
+//   TextureCooker [--format auto|bc1|bc3|rgba8] [--linear] input output
+#include "texturefile.h"
+
+#include <fmt/format.h>
+
+#include <array>
+#include <cmath>
+#include <string_view>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+enum class CookFormat { Auto, BC1, BC3, RGBA8 };
+
+struct CookOptions {
+    CookFormat format = CookFormat::Auto;
+    bool linear = false;    // data rather than color, eg. normal maps: UNORM formats and no sRGB aware filtering
+    std::filesystem::path input;
+    std::filesystem::path output;
+};
+
+struct Image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;    // RGBA8
+};
+
+void printUsage(){
+    fmt::println("Usage: TextureCooker [--format auto|bc1|bc3|rgba8] [--linear] input output");
+    fmt::println("  --format F  block format, auto picks bc3 when the image has alpha and bc1 otherwise");
+    fmt::println("  --linear    the image is data, not sRGB color");
+}
+
+bool parseOptions(int argc, char* argv[], CookOptions& options){
+    std::vector<std::string_view> positional;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        if(arg == "--format" && i + 1 < argc){
+            std::string_view name = argv[++i];
+            if(name == "auto") options.format = CookFormat::Auto;
+            else if(name == "bc1") options.format = CookFormat::BC1;
+            else if(name == "bc3") options.format = CookFormat::BC3;
+            else if(name == "rgba8") options.format = CookFormat::RGBA8;
+            else return false;
+        } else if(arg == "--linear"){
+            options.linear = true;
+        } else if(!arg.empty() && arg[0] == '-'){
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    if(positional.size() != 2){
+        return false;
+    }
+
+    options.input = positional[0];
+    options.output = positional[1];
+    return true;
+}
+
+// 2x2 box filter, odd edges reuse the last texel. Color channels are averaged in linear space unless linear is set
+Image downsample(const Image& src, bool linear){
+    static std::array<float, 256> toLinear = [](){
+        std::array<float, 256> table;
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.f;
+            table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+
+    auto toSrgb = [](float c){
+        c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+    };
+
+    Image dst;
+    dst.width = std::max(1u, src.width / 2);
+    dst.height = std::max(1u, src.height / 2);
+    dst.pixels.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+
+    for (uint32_t y = 0; y < dst.height; y++)
+    {
+        for (uint32_t x = 0; x < dst.width; x++)
+        {
+            uint32_t x0 = std::min(x * 2, src.width - 1);
+            uint32_t x1 = std::min(x * 2 + 1, src.width - 1);
+            uint32_t y0 = std::min(y * 2, src.height - 1);
+            uint32_t y1 = std::min(y * 2 + 1, src.height - 1);
+
+            const uint8_t* texels[4] = {
+                &src.pixels[(static_cast<size_t>(y0) * src.width + x0) * 4],
+                &src.pixels[(static_cast<size_t>(y0) * src.width + x1) * 4],
+                &src.pixels[(static_cast<size_t>(y1) * src.width + x0) * 4],
+                &src.pixels[(static_cast<size_t>(y1) * src.width + x1) * 4]
+            };
+
+            uint8_t* out = &dst.pixels[(static_cast<size_t>(y) * dst.width + x) * 4];
+            for (int c = 0; c < 4; c++)
+            {
+                if(c < 3 && !linear){
+                    float sum = toLinear[texels[0][c]] + toLinear[texels[1][c]] + toLinear[texels[2][c]] + toLinear[texels[3][c]];
+                    out[c] = toSrgb(sum / 4.f);
+                } else {
+                    out[c] = static_cast<uint8_t>((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+                }
+            }
+        }
+    }
+
+    return dst;
+}
+
+uint16_t to565(const float color[3]){
+    uint32_t r = static_cast<uint32_t>(std::clamp(color[0], 0.f, 255.f) * 31.f / 255.f + 0.5f);
+    uint32_t g = static_cast<uint32_t>(std::clamp(color[1], 0.f, 255.f) * 63.f / 255.f + 0.5f);
+    uint32_t b = static_cast<uint32_t>(std::clamp(color[2], 0.f, 255.f) * 31.f / 255.f + 0.5f);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void from565(uint16_t value, int color[3]){
+    color[0] = ((value >> 11) & 31) * 255 / 31;
+    color[1] = ((value >> 5) & 63) * 255 / 63;
+    color[2] = (value & 31) * 255 / 31;
+}
+
+// Endpoints at the ends of the block's principal axis, every texel snapped to the closest of the 4 palette colors.
+// Always the 4 color mode, which is also the only one BC3 allows
+void encodeColorBlock(const uint8_t texels[16][4], uint8_t* out){
+    float mean[3] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            mean[c] += texels[i][c] / 16.f;
+        }
+    }
+
+    float covariance[6] = {};   // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++)
+    {
+        float d[3] = {texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2]};
+        covariance[0] += d[0] * d[0];
+        covariance[1] += d[0] * d[1];
+        covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1];
+        covariance[4] += d[1] * d[2];
+        covariance[5] += d[2] * d[2];
+    }
+
+    // a few power iterations are plenty for a 3x3
+    float axis[3] = {1.f, 1.f, 1.f};
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+        };
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if(length < 1e-6f){
+            break;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float minProjection = 1e9f;
+    float maxProjection = -1e9f;
+    for (int i = 0; i < 16; i++)
+    {
+        float projection = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+
+    float maxColor[3], minColor[3];
+    for (int c = 0; c < 3; c++)
+    {
+        maxColor[c] = mean[c] + axis[c] * maxProjection;
+        minColor[c] = mean[c] + axis[c] * minProjection;
+    }
+
+    uint16_t color0 = to565(maxColor);
+    uint16_t color1 = to565(minColor);
+    if(color0 < color1){
+        std::swap(color0, color1);
+    }
+
+    int palette[4][3];
+    from565(color0, palette[0]);
+    from565(color1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if(color0 != color1){
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            int bestDistance = INT32_MAX;
+            for (int p = 0; p < 4; p++)
+            {
+                int dr = texels[i][0] - palette[p][0];
+                int dg = texels[i][1] - palette[p][1];
+                int db = texels[i][2] - palette[p][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if(distance < bestDistance){
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (i * 2);
+        }
+    }
+
+    memcpy(out, &color0, 2);
+    memcpy(out + 2, &color1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+// 8 interpolated alphas between the block's min and max
+void encodeAlphaBlock(const uint8_t texels[16][4], uint8_t* out){
+    uint8_t alpha0 = 0;
+    uint8_t alpha1 = 255;
+    for (int i = 0; i < 16; i++)
+    {
+        alpha0 = std::max(alpha0, texels[i][3]);
+        alpha1 = std::min(alpha1, texels[i][3]);
+    }
+
+    uint64_t indices = 0;
+    if(alpha0 != alpha1){
+        int palette[8] = {alpha0, alpha1};
+        for (int p = 1; p < 7; p++)
+        {
+            palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            for (int p = 1; p < 8; p++)
+            {
+                if(std::abs(texels[i][3] - palette[p]) < std::abs(texels[i][3] - palette[best])){
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (i * 3);
+        }
+    }
+
+    out[0] = alpha0;
+    out[1] = alpha1;
+    for (int b = 0; b < 6; b++)
+    {
+        out[2 + b] = static_cast<uint8_t>(indices >> (b * 8));
+    }
+}
+
+std::vector<uint8_t> encodeLevel(const Image& image, CookFormat format){
+    if(format == CookFormat::RGBA8){
+        return image.pixels;
+    }
+
+    uint32_t bytesPerBlock = format == CookFormat::BC1 ? 8 : 16;
+    uint32_t blocksWide = (image.width + 3) / 4;
+    uint32_t blocksHigh = (image.height + 3) / 4;
+    std::vector<uint8_t> blocks(static_cast<size_t>(blocksWide) * blocksHigh * bytesPerBlock);
+
+    for (uint32_t by = 0; by < blocksHigh; by++)
+    {
+        for (uint32_t bx = 0; bx < blocksWide; bx++)
+        {
+            // texels past the edge repeat the last row and column
+            uint8_t texels[16][4];
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                uint32_t x = std::min(bx * 4 + i % 4, image.width - 1);
+                uint32_t y = std::min(by * 4 + i / 4, image.height - 1);
+                memcpy(texels[i], &image.pixels[(static_cast<size_t>(y) * image.width + x) * 4], 4);
+            }
+
+            uint8_t* out = &blocks[(static_cast<size_t>(by) * blocksWide + bx) * bytesPerBlock];
+            if(format == CookFormat::BC3){
+                encodeAlphaBlock(texels, out);
+                encodeColorBlock(texels, out + 8);
+            } else {
+                encodeColorBlock(texels, out);
+            }
+        }
+    }
+
+    return blocks;
+}
+
+int main(int argc, char* argv[]){
+    CookOptions options;
+    if(!parseOptions(argc, argv, options)){
+        printUsage();
+        return 1;
+    }
+
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(options.input.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if(pixels == nullptr){
+        fmt::println("Failed to decode {}: {}", options.input.string(), stbi_failure_reason());
+        return 1;
+    }
+
+    Image image;
+    image.width = static_cast<uint32_t>(width);
+    image.height = static_cast<uint32_t>(height);
+    image.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(pixels);
+
+    CookFormat format = options.format;
+    if(format == CookFormat::Auto){
+        bool hasAlpha = false;
+        for (size_t i = 3; i < image.pixels.size() && !hasAlpha; i += 4)
+        {
+            hasAlpha = image.pixels[i] != 255;
+        }
+        format = hasAlpha ? CookFormat::BC3 : CookFormat::BC1;
+    }
+
+    TextureFile::Header header{};
+    header.width = image.width;
+    header.height = image.height;
+    switch(format){
+        case CookFormat::BC1:
+            header.vkFormat = options.linear ? VK_FORMAT_BC1_RGB_UNORM_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+            break;
+        case CookFormat::BC3:
+            header.vkFormat = options.linear ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC3_SRGB_BLOCK;
+            break;
+        default:
+            header.vkFormat = options.linear ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB;
+            break;
+    }
+    TextureFile::blockLayout(static_cast<VkFormat>(header.vkFormat), header.blockSize, header.bytesPerBlock);
+
+    std::vector<std::vector<uint8_t>> levels;
+    while(true){
+        levels.push_back(encodeLevel(image, format));
+        if(image.width == 1 && image.height == 1){
+            break;
+        }
+        image = downsample(image, options.linear);
+    }
+
+    if(!TextureFile::write(options.output, header, levels)){
+        fmt::println("Failed to write {}", options.output.string());
+        return 1;
+    }
+
+    fmt::println("Cooked {} ({}x{}, {} levels)", options.output.string(), header.width, header.height, levels.size());
+    return 0;
+}